@@ -0,0 +1,174 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "elf_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <elf.h>
+
+bool elf_read(const char *path, elf_image &img)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr)
+    {
+        perror("elf_read: fopen failed");
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    img.file.resize(len > 0 ? len : 0);
+    bool ok = len > 0 and fread(img.file.data(), 1, len, f) == static_cast<size_t>(len);
+    fclose(f);
+    if (not ok)
+    {
+        fprintf(stderr, "elf_read: failed to read %s\n", path);
+        return false;
+    }
+
+    const uint8_t *base = img.file.data();
+    size_t size = img.file.size();
+    Elf32_Ehdr ehdr;
+    if (size < sizeof(ehdr))
+    {
+        fprintf(stderr, "elf_read: %s is truncated\n", path);
+        return false;
+    }
+    memcpy(&ehdr, base, sizeof(ehdr));
+    if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 or ehdr.e_ident[EI_CLASS] != ELFCLASS32 or
+        ehdr.e_ident[EI_DATA] != ELFDATA2LSB or ehdr.e_machine != EM_RISCV)
+    {
+        fprintf(stderr, "elf_read: %s is not a 32-bit little-endian RISC-V ELF file\n", path);
+        return false;
+    }
+    img.entry = ehdr.e_entry;
+    if (ehdr.e_phnum != 0 and ehdr.e_phentsize < sizeof(Elf32_Phdr))
+    {
+        fprintf(stderr, "elf_read: %s has an unexpected program header size\n", path);
+        return false;
+    }
+
+    for (unsigned i = 0; i < ehdr.e_phnum; i++)
+    {
+        Elf32_Phdr phdr;
+        size_t off = ehdr.e_phoff + size_t(i) * ehdr.e_phentsize;
+        if (off + sizeof(phdr) > size)
+        {
+            fprintf(stderr, "elf_read: %s has a truncated program header\n", path);
+            return false;
+        }
+        memcpy(&phdr, base + off, sizeof(phdr));
+        if (phdr.p_type != PT_LOAD or phdr.p_memsz == 0)
+            continue;
+        if (size_t(phdr.p_offset) + phdr.p_filesz > size or phdr.p_filesz > phdr.p_memsz)
+        {
+            fprintf(stderr, "elf_read: %s has a malformed segment\n", path);
+            return false;
+        }
+        img.segments.push_back({phdr.p_paddr, phdr.p_filesz, phdr.p_memsz, base + phdr.p_offset});
+    }
+    return true;
+}
+
+static bool read_section_headers(const elf_image &img, std::vector<Elf32_Shdr> &shdrs)
+{
+    Elf32_Ehdr ehdr;
+    memcpy(&ehdr, img.file.data(), sizeof(ehdr));
+    if (ehdr.e_shnum != 0 and ehdr.e_shentsize < sizeof(Elf32_Shdr))
+    {
+        fprintf(stderr, "elf: unexpected section header size\n");
+        return false;
+    }
+    if (size_t(ehdr.e_shoff) + size_t(ehdr.e_shnum) * ehdr.e_shentsize > img.file.size())
+    {
+        fprintf(stderr, "elf: truncated section headers\n");
+        return false;
+    }
+    shdrs.resize(ehdr.e_shnum);
+    for (unsigned i = 0; i < ehdr.e_shnum; i++)
+        memcpy(&shdrs[i], img.file.data() + ehdr.e_shoff + size_t(i) * ehdr.e_shentsize, sizeof(Elf32_Shdr));
+    return true;
+}
+
+bool elf_read_sections(const elf_image &img, std::vector<elf_section> &secs)
+{
+    std::vector<Elf32_Shdr> shdrs;
+    if (not read_section_headers(img, shdrs))
+        return false;
+    for (const Elf32_Shdr &sh : shdrs)
+    {
+        if (not (sh.sh_flags & SHF_ALLOC) or sh.sh_size == 0)
+            continue;
+        secs.push_back({sh.sh_addr, sh.sh_size, (sh.sh_flags & SHF_EXECINSTR) != 0, (sh.sh_flags & SHF_WRITE) != 0});
+    }
+    return true;
+}
+
+bool elf_read_symbols(const elf_image &img, std::vector<elf_symbol> &syms)
+{
+    const uint8_t *base = img.file.data();
+    size_t size = img.file.size();
+    std::vector<Elf32_Shdr> shdrs;
+    if (not read_section_headers(img, shdrs))
+        return false;
+
+    for (const Elf32_Shdr &symtab : shdrs)
+    {
+        if (symtab.sh_type != SHT_SYMTAB)
+            continue;
+        if (symtab.sh_link >= shdrs.size())
+            continue;
+        const Elf32_Shdr &strtab = shdrs[symtab.sh_link];
+        if (size_t(symtab.sh_offset) + symtab.sh_size > size or size_t(strtab.sh_offset) + strtab.sh_size > size)
+        {
+            fprintf(stderr, "elf_read_symbols: malformed symbol table\n");
+            return false;
+        }
+        for (size_t off = 0; off + sizeof(Elf32_Sym) <= symtab.sh_size; off += sizeof(Elf32_Sym))
+        {
+            Elf32_Sym sym;
+            memcpy(&sym, base + symtab.sh_offset + off, sizeof(sym));
+            unsigned type = ELF32_ST_TYPE(sym.st_info);
+            if (type != STT_FUNC and type != STT_NOTYPE)
+                continue;
+            if (sym.st_shndx == SHN_UNDEF or sym.st_shndx >= shdrs.size() or sym.st_name >= strtab.sh_size)
+                continue;
+            if (not (shdrs[sym.st_shndx].sh_flags & SHF_EXECINSTR))
+                continue;
+            const char *name = reinterpret_cast<const char *>(base + strtab.sh_offset + sym.st_name);
+            size_t len = strnlen(name, strtab.sh_size - sym.st_name);
+            // skip unnamed symbols, local labels and mapping symbols
+            if (len == 0 or name[0] == '.' or name[0] == '$')
+                continue;
+            syms.push_back({sym.st_value, sym.st_size, std::string(name, len)});
+        }
+    }
+    // functions before labels at the same address
+    std::sort(syms.begin(), syms.end(), [](const elf_symbol &a, const elf_symbol &b) {
+        return a.addr != b.addr ? a.addr < b.addr : a.size > b.size;
+    });
+    return true;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Minimal reader for the 32-bit little-endian RISC-V ELF files built under
+ * app/. */
+
+struct elf_segment {
+    uint32_t addr;  // physical load address
+    uint32_t filesz;
+    uint32_t memsz; // bytes past filesz are zero
+    const uint8_t *data;
+};
+
+struct elf_image {
+    std::vector<uint8_t> file;
+    std::vector<elf_segment> segments; // PT_LOAD segments only
+    uint32_t entry = 0;
+};
+
+struct elf_symbol {
+    uint32_t addr;
+    uint32_t size; // 0 for labels without a size
+    std::string name;
+};
+
+struct elf_section {
+    uint32_t addr;
+    uint32_t size;
+    bool exec;
+    bool write;
+};
+
+bool elf_read(const char *path, elf_image &img);
+
+// sections occupying memory at runtime (SHF_ALLOC) that are not empty
+bool elf_read_sections(const elf_image &img, std::vector<elf_section> &secs);
+
+// functions and labels in executable sections, sorted by address
+bool elf_read_symbols(const elf_image &img, std::vector<elf_symbol> &syms);
@@ -23,12 +23,42 @@
  */
 
 #include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <signal.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cassert>
+#include <type_traits>
+#include <verilated.h>
+#if IBEX_SAVABLE
+#include <verilated_save.h>
+#endif
+#if VM_TRACE_FST
+#include <verilated_fst_c.h>
+#elif VM_TRACE
 #include <verilated_vcd_c.h>
+#endif
 
 #include <Vibex_top.h>
+#include <Vibex_top__Dpi.h>
+#include <svdpi.h>
+
+#include "elf_image.h"
+#include "rv32_iss.h"
 
 #include "lib/utils/log.h"
 
@@ -40,31 +70,39 @@ extern "C"
 }
 
 #define IBEX_VERILATOR_DEBUG 0
-#define IBEX_VERILATOR_TRACE 0
-#define IBEX_VERILATOR_TRACE_LEVEL 40
+// the first instruction is fetched from 0x100080, mtvec starts at 0x100000
+#define IBEX_BOOT_ADDR 0x00100080
 
 /* **************************************************************************
  * signal handling
  * ************************************************************************** */
 
-static uint64_t main_time = 0;
-static volatile bool exiting = 0;
+// every core runs on its own thread, state of a core is thread_local
+static unsigned num_cores = 1;
+static thread_local unsigned core_id = 0;
+
+static thread_local uint64_t main_time = 0;
+static thread_local uint64_t cur_cycle = 0;
+static std::atomic<bool> exiting{false};
+static thread_local bool halted = false; // the guest wrote the halt register
+static std::atomic<unsigned> cores_halted{0}; // the simulation ends once all did
 static void sigint_handler([[maybe_unused]] int _dummy)
 {
     exiting = true;
 }
+// incremented per SIGUSR1, each core prints its statistics once per request
+static volatile sig_atomic_t stats_request = 0;
 static void sigusr1_handler([[maybe_unused]] int _dummy)
 {
-    sim_log::LogError("main_time = %lu\n", main_time);
+    stats_request = stats_request + 1;
 }
-
-#define INSTR_REQ_ID 0
-#define DATA_REQ_ID 1
-#define DATA_WRITE_ID 2
-
-static bool pending_instr_req = false;
-static bool pending_data = false;
-static bool pending_data_write = false;
+#if VM_TRACE
+static volatile sig_atomic_t trace_toggle = 0;
+static void sigusr2_handler([[maybe_unused]] int _dummy)
+{
+    trace_toggle = 1;
+}
+#endif
 
 struct delayed {
     bool instr_rvalid_i;
@@ -73,156 +111,3670 @@ struct delayed {
     uint32_t data_rdata_i;
 };
 
-void send_core_to_mem(struct SimbricksMemIf &memif, uint64_t cur_ts, Vibex_top &dut, delayed &delay)
+/* **************************************************************************
+ * performance statistics
+ *
+ * Counters that tell whether a run is bound by the model, the memory channel
+ * or memory latency. They are printed on SIGUSR1 and at exit, and optionally
+ * written as one JSON object per line every stats_interval cycles.
+ * ************************************************************************** */
+
+struct sim_stats {
+    uint64_t h2m_reads = 0;
+    uint64_t h2m_writes = 0;
+    uint64_t h2m_syncs = 0;
+    uint64_t m2h_readcomps = 0;
+    uint64_t m2h_writecomps = 0;
+    uint64_t m2h_syncs = 0;
+    uint64_t polls = 0;
+    uint64_t empty_polls = 0;    // polls that found no message, e.g. waiting for the peer
+    uint64_t alloc_failures = 0; // SimbricksMemIfH2MOutAlloc returned nullptr
+    uint64_t instr_stall_cycles = 0; // fetch outstanding, no response this cycle
+    uint64_t data_stall_cycles = 0;  // load/store outstanding, no response this cycle
+
+    std::chrono::steady_clock::time_point wall_start;
+    uint64_t start_cycle = 0; // cur_cycle at wall_start, non-zero after a restore
+    FILE *file = nullptr; // periodic JSON lines
+    uint64_t interval = 1000000; // cycles between JSON lines
+    sig_atomic_t request_seen = 0; // stats_request handled so far
+    uint64_t next_cycle = UINT64_MAX;
+    uint64_t last_cycle = 0;
+    double last_wall_s = 0;
+};
+
+static thread_local sim_stats stats;
+static const char *stats_path = nullptr; // --stats-file
+
+// serializes the reports of the cores on stderr
+static std::mutex report_lock;
+
+static void report_header()
 {
-    volatile union SimbricksProtoMemH2M *msg;
+    if (num_cores > 1)
+        fprintf(stderr, "core: id=%u\n", core_id);
+}
 
-    delay.instr_rvalid_i = 0;
-    delay.data_rvalid_i = 0;
+// file name for the output of the current core, the first core uses path itself
+static std::string core_file_path(const char *path)
+{
+    std::string name = path;
+    if (core_id != 0)
+        name += ".core" + std::to_string(core_id);
+    return name;
+}
+
+static inline double stats_wall_s()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - stats.wall_start).count();
+}
+
+static void stats_print()
+{
+    double wall_s = stats_wall_s();
+    fprintf(stderr, "sim: cycles=%lu wall_s=%.3f khz=%.1f main_time=%lu\n", cur_cycle, wall_s,
+            wall_s > 0 ? (cur_cycle - stats.start_cycle) / wall_s / 1000 : 0.0, main_time);
+    fprintf(stderr,
+            "chan: h2m_reads=%lu h2m_writes=%lu h2m_syncs=%lu m2h_readcomps=%lu m2h_writecomps=%lu m2h_syncs=%lu "
+            "polls=%lu empty_polls=%lu alloc_failures=%lu\n",
+            stats.h2m_reads, stats.h2m_writes, stats.h2m_syncs, stats.m2h_readcomps, stats.m2h_writecomps,
+            stats.m2h_syncs, stats.polls, stats.empty_polls, stats.alloc_failures);
+    fprintf(stderr, "stall: instr_cycles=%lu data_cycles=%lu\n", stats.instr_stall_cycles,
+            stats.data_stall_cycles);
+}
+
+static void stats_write_json()
+{
+    double wall_s = stats_wall_s();
+    double interval_s = wall_s - stats.last_wall_s;
+    fprintf(stats.file,
+            "{\"cycles\": %lu, \"main_time\": %lu, \"wall_s\": %.6f, \"khz\": %.3f, \"interval_khz\": %.3f, "
+            "\"h2m_reads\": %lu, \"h2m_writes\": %lu, \"h2m_syncs\": %lu, \"m2h_readcomps\": %lu, "
+            "\"m2h_writecomps\": %lu, \"m2h_syncs\": %lu, \"polls\": %lu, \"empty_polls\": %lu, \"alloc_failures\": %lu, "
+            "\"instr_stall_cycles\": %lu, \"data_stall_cycles\": %lu}\n",
+            cur_cycle, main_time, wall_s, wall_s > 0 ? (cur_cycle - stats.start_cycle) / wall_s / 1000 : 0.0,
+            interval_s > 0 ? (cur_cycle - stats.last_cycle) / interval_s / 1000 : 0.0, stats.h2m_reads,
+            stats.h2m_writes, stats.h2m_syncs, stats.m2h_readcomps, stats.m2h_writecomps, stats.m2h_syncs,
+            stats.polls, stats.empty_polls, stats.alloc_failures, stats.instr_stall_cycles, stats.data_stall_cycles);
+    fflush(stats.file);
+    stats.last_cycle = cur_cycle;
+    stats.last_wall_s = wall_s;
+}
+
+// called from the main loop once the next JSON line is due or on SIGUSR1
+static void stats_poll()
+{
+    if (stats_request != stats.request_seen)
+    {
+        stats.request_seen = stats_request;
+        std::lock_guard<std::mutex> lock(report_lock);
+        report_header();
+        stats_print();
+    }
+    if (cur_cycle >= stats.next_cycle)
+    {
+        stats_write_json();
+        stats.next_cycle = cur_cycle + stats.interval;
+    }
+}
+
+/* **************************************************************************
+ * memory channels
+ *
+ * By default instruction fetches and data accesses share one SimBricks memory
+ * interface. With a second interface for instruction fetches (Harvard mode)
+ * each port has its own queue, synchronization and polling, so fetches do
+ * not wait behind data traffic and can be served by a separate memory.
+ * ************************************************************************** */
+
+struct mem_channel {
+    const char *name;
+    struct SimbricksMemIf memif;
+    struct SimbricksAdapterParams *params = nullptr;
+    bool sync = false;
+    uint64_t next_sync = 0; // earliest time an outbound sync can be due
+    uint64_t next_poll = 0; // timestamp of the next inbound message
+};
+
+#define MAX_CHANNELS 2
+
+static thread_local mem_channel chans[MAX_CHANNELS] = {{"mem"}, {"imem"}};
+static thread_local unsigned num_chans = 1;
+
+/* **************************************************************************
+ * channel record and replay
+ *
+ * --record=FILE logs the messages the memory side sends on the channels
+ * together with the simulated time at which the adapter consumed them, and
+ * the times at which a request found no free slot in the outbound queue.
+ * --replay=FILE feeds such a log back without connecting to any peer: each
+ * message is handed over at the time it was consumed, requests go nowhere,
+ * and allocations fail at the recorded times. With the same options and an
+ * equivalent model the replayed run is cycle-identical to the recorded one,
+ * in one process and without sockets. Syncs from the peer are not logged,
+ * the consumption times already say when each message was due.
+ *
+ * The log starts with a header: magic, version, number of channels, clock
+ * period, start time and per channel the inbound entry size, all 32 or 64 bit
+ * little endian. Each record starts with a byte holding the channel in the
+ * upper and the kind in the lower four bits, followed by the time since the
+ * previous record of the channel as ULEB128. Completions add the req_id, and
+ * read completions the data length and the data. Every channel ends with a
+ * REPLAY_END record at the time the simulation stopped.
+ * ************************************************************************** */
+
+#define REPLAY_MAGIC "IBEXM2H"
+#define REPLAY_VERSION 1
+#define REPLAY_BUF_SIZE 4096
+
+enum replay_kind : uint8_t {
+    REPLAY_READCOMP,
+    REPLAY_WRITECOMP,
+    REPLAY_ALLOC_FAIL,
+    REPLAY_END,
+};
+
+struct replay_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_chans;
+    uint64_t clock_period;
+    uint64_t start_time;
+    uint32_t in_entries_size[MAX_CHANNELS];
+};
+
+static const char *record_path = nullptr; // --record
+static const char *replay_path = nullptr; // --replay
+
+// per channel, the log is read through one stream per channel
+struct replay_chan {
+    FILE *file = nullptr;
+    uint64_t time = 0; // of the last record read or written
+    // next message, valid unless at_end
+    replay_kind kind = REPLAY_END;
+    uint64_t msg_time = UINT64_MAX;
+    uint8_t req_id = 0;
+    uint32_t len = 0;
+    bool at_end = false;
+    std::deque<uint64_t> alloc_fails; // read ahead of the next message
+    // while recording, the length of the outstanding read per req_id, which
+    // txn_tag() keeps within a byte
+    uint32_t read_len[256] = {};
+    alignas(64) uint8_t in_buf[REPLAY_BUF_SIZE];
+    alignas(64) uint8_t out_buf[REPLAY_BUF_SIZE];
+};
+
+static thread_local replay_chan rchans[MAX_CHANNELS];
+static thread_local FILE *record_file = nullptr;
+static thread_local bool replay_diverged = false;
+static thread_local uint64_t replay_msgs = 0;
+
+static inline unsigned chan_index(const mem_channel &ch)
+{
+    return &ch - chans;
+}
+
+static void replay_write_uleb(FILE *f, uint64_t v)
+{
+    do
+    {
+        uint8_t byte = v & 0x7f;
+        v >>= 7;
+        fputc(byte | (v ? 0x80 : 0), f);
+    } while (v);
+}
+
+static bool replay_read_uleb(FILE *f, uint64_t &v)
+{
+    v = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        int byte = fgetc(f);
+        if (byte == EOF)
+            return false;
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (not (byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+static void record_event(unsigned c, replay_kind kind, uint64_t time)
+{
+    fputc(c << 4 | kind, record_file);
+    replay_write_uleb(record_file, time - rchans[c].time);
+    rchans[c].time = time;
+}
+
+static void replay_fail(const char *what)
+{
+    if (not replay_diverged)
+        fprintf(stderr, "replay: diverged from the log at %lu ps: %s\n", main_time, what);
+    replay_diverged = true;
+    exiting = true;
+}
 
-    // handel instruction read
-    if (dut.instr_req_o and not pending_instr_req)
+// reads up to the next message of channel c, collecting allocation failures
+static void replay_advance(unsigned c)
+{
+    replay_chan &rc = rchans[c];
+    while (not rc.at_end)
     {
-        msg = SimbricksMemIfH2MOutAlloc(&memif, cur_ts);
-        if (msg == nullptr)
+        int head = fgetc(rc.file);
+        uint64_t delta, v;
+        if (head == EOF or not replay_read_uleb(rc.file, delta))
+        {
+            replay_fail("log truncated");
+            rc.at_end = true;
+            rc.msg_time = UINT64_MAX;
+            return;
+        }
+        unsigned chan = head >> 4;
+        replay_kind kind = replay_kind(head & 0xf);
+        if (chan >= MAX_CHANNELS)
+        {
+            replay_fail("bad record");
+            rc.at_end = true;
+            return;
+        }
+        // records of the other channel, read through their own stream
+        if (chan != c)
         {
-    #if IBEX_VERILATOR_DEBUG
-            sim_log::LogWarn("send_core_to_mem msg nullptr\n");
-    #endif
+            if (kind == REPLAY_READCOMP or kind == REPLAY_WRITECOMP)
+                replay_read_uleb(rc.file, v);
+            if (kind == REPLAY_READCOMP and replay_read_uleb(rc.file, v))
+                fseek(rc.file, v, SEEK_CUR);
+            continue;
+        }
+        rc.time += delta;
+        switch (kind)
+        {
+        case REPLAY_ALLOC_FAIL:
+            rc.alloc_fails.push_back(rc.time);
+            continue;
+        case REPLAY_END:
+            // consumed messages never come later than this
+            rc.at_end = true;
+            rc.msg_time = rc.time + 1;
+            return;
+        case REPLAY_READCOMP:
+        case REPLAY_WRITECOMP:
+            rc.kind = kind;
+            rc.msg_time = rc.time;
+            replay_read_uleb(rc.file, v);
+            rc.req_id = v;
+            rc.len = 0;
+            if (kind == REPLAY_READCOMP)
+            {
+                replay_read_uleb(rc.file, v);
+                if (v > REPLAY_BUF_SIZE - sizeof(struct SimbricksProtoMemM2HReadcomp))
+                {
+                    replay_fail("read completion too long");
+                    rc.at_end = true;
+                    return;
+                }
+                rc.len = v;
+                volatile struct SimbricksProtoMemM2HReadcomp *rcomp =
+                    reinterpret_cast<volatile struct SimbricksProtoMemM2HReadcomp *>(rc.in_buf);
+                if (fread(const_cast<uint8_t *>(rcomp->data), 1, rc.len, rc.file) != rc.len)
+                    replay_fail("log truncated");
+            }
+            return;
+        default:
+            replay_fail("bad record");
+            rc.at_end = true;
             return;
         }
+    }
+}
 
-        volatile struct SimbricksProtoMemH2MRead &read = msg->read;
-        read.addr = dut.instr_addr_o;
-        read.req_id = INSTR_REQ_ID;
-        read.len = 4;
-        pending_instr_req = true;
-#if IBEX_VERILATOR_DEBUG
-        sim_log::LogInfo("[%lu] send_core_to_mem instruction read addr=%lx len=%u nullptr\n", main_time, dut.instr_addr_o, 4);
-        sim_log::FlushLog();
-#endif
-        SimbricksMemIfH2MOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
+static bool record_open(uint64_t clock_period, uint64_t start_time)
+{
+    record_file = fopen(core_file_path(record_path).c_str(), "wb");
+    if (record_file == nullptr)
+    {
+        perror("opening record file failed");
+        return false;
+    }
+    replay_header hdr = {};
+    memcpy(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic));
+    hdr.version = REPLAY_VERSION;
+    hdr.num_chans = num_chans;
+    hdr.clock_period = clock_period;
+    hdr.start_time = start_time;
+    for (unsigned c = 0; c < num_chans; c++)
+    {
+        hdr.in_entries_size[c] = chans[c].memif.base.params.in_entries_size;
+        rchans[c].time = start_time;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, record_file);
+    return true;
+}
+
+// sets up the channels from the log instead of connecting them
+static void replay_close_chans()
+{
+    for (replay_chan &rc : rchans)
+    {
+        if (rc.file != nullptr)
+            fclose(rc.file);
+        rc.file = nullptr;
     }
+}
 
-    // handel data read
-    if (dut.data_req_o and not dut.data_we_o and not pending_data)
+static bool replay_open(uint64_t clock_period, uint64_t start_time)
+{
+    std::string path = core_file_path(replay_path);
+    replay_header hdr;
+    for (unsigned c = 0; c < num_chans; c++)
     {
-        msg = SimbricksMemIfH2MOutAlloc(&memif, cur_ts);
-        if (msg == nullptr)
+        FILE *f = fopen(path.c_str(), "rb");
+        if (f == nullptr)
         {
-    #if IBEX_VERILATOR_DEBUG
-            sim_log::LogWarn("send_core_to_mem msg nullptr\n");
-    #endif
-            return;
+            perror("opening replay log failed");
+            replay_close_chans();
+            return false;
+        }
+        rchans[c].file = f;
+        if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+        {
+            fprintf(stderr, "replay: %s is truncated, no complete header\n", path.c_str());
+            replay_close_chans();
+            return false;
+        }
+    }
+    if (memcmp(hdr.magic, REPLAY_MAGIC, sizeof(hdr.magic)) != 0 or hdr.version != REPLAY_VERSION)
+    {
+        fprintf(stderr, "replay: %s is not a channel log of version %u\n", path.c_str(), REPLAY_VERSION);
+        replay_close_chans();
+        return false;
+    }
+    if (hdr.num_chans != num_chans or hdr.clock_period != clock_period or hdr.start_time != start_time)
+    {
+        fprintf(stderr,
+                "replay: %s has %u channels, clock period %lu ps and start time %lu ps, the command line %u, "
+                "%lu ps and %lu ps\n",
+                path.c_str(), hdr.num_chans, hdr.clock_period, hdr.start_time, num_chans, clock_period, start_time);
+        replay_close_chans();
+        return false;
+    }
+    for (unsigned c = 0; c < num_chans; c++)
+    {
+        // the messages define when something is due, as in synchronized mode
+        chans[c].sync = true;
+        chans[c].memif.base.params.in_entries_size = hdr.in_entries_size[c];
+        chans[c].memif.base.params.out_entries_size = REPLAY_BUF_SIZE;
+        rchans[c].time = start_time;
+        replay_advance(c);
+    }
+    return true;
+}
+
+static void replay_close()
+{
+    if (record_file != nullptr)
+    {
+        for (unsigned c = 0; c < num_chans; c++)
+            record_event(c, REPLAY_END, main_time);
+        fclose(record_file);
+        record_file = nullptr;
+    }
+    replay_close_chans();
+}
+
+/* SimBricks memory interface calls of the adapter, recorded or replayed. */
+
+static volatile union SimbricksProtoMemH2M *chan_out_alloc(mem_channel &ch, uint64_t ts)
+{
+    unsigned c = chan_index(ch);
+    if (replay_path != nullptr)
+    {
+        std::deque<uint64_t> &fails = rchans[c].alloc_fails;
+        if (not fails.empty() and fails.front() < ts)
+            replay_fail("recorded allocation failure did not happen");
+        if (not fails.empty() and fails.front() <= ts)
+        {
+            fails.pop_front();
+            return nullptr;
+        }
+        return reinterpret_cast<volatile union SimbricksProtoMemH2M *>(rchans[c].out_buf);
+    }
+    volatile union SimbricksProtoMemH2M *msg = SimbricksMemIfH2MOutAlloc(&ch.memif, ts);
+    if (msg == nullptr and record_file != nullptr)
+        record_event(c, REPLAY_ALLOC_FAIL, ts);
+    return msg;
+}
+
+static void chan_out_send(mem_channel &ch, volatile union SimbricksProtoMemH2M *msg, uint8_t type)
+{
+    if (record_file != nullptr and type == SIMBRICKS_PROTO_MEM_H2M_MSG_READ)
+        rchans[chan_index(ch)].read_len[msg->read.req_id & 0xff] = msg->read.len;
+    if (replay_path == nullptr)
+        SimbricksMemIfH2MOutSend(&ch.memif, msg, type);
+}
+
+static inline uint64_t chan_out_next_sync(mem_channel &ch)
+{
+    if (replay_path != nullptr)
+        return UINT64_MAX;
+    return SimbricksBaseIfOutNextSync(&ch.memif.base);
+}
+
+static inline int chan_out_sync(mem_channel &ch, uint64_t ts)
+{
+    if (replay_path != nullptr)
+        return 0;
+    return SimbricksMemIfH2MOutSync(&ch.memif, ts);
+}
+
+static inline uint64_t chan_in_timestamp(mem_channel &ch)
+{
+    if (replay_path != nullptr)
+        return rchans[chan_index(ch)].msg_time;
+    return SimbricksMemIfM2HInTimestamp(&ch.memif);
+}
+
+static volatile union SimbricksProtoMemM2H *chan_in_poll(mem_channel &ch, uint64_t ts)
+{
+    unsigned c = chan_index(ch);
+    if (replay_path != nullptr)
+    {
+        replay_chan &rc = rchans[c];
+        if (rc.at_end)
+        {
+            if (ts >= rc.msg_time)
+                replay_fail("log ended");
+            return nullptr;
         }
+        if (rc.msg_time > ts)
+            return nullptr;
+        volatile union SimbricksProtoMemM2H *msg = reinterpret_cast<volatile union SimbricksProtoMemM2H *>(rc.in_buf);
+        if (rc.kind == REPLAY_READCOMP)
+            msg->readcomp.req_id = rc.req_id;
+        else
+            msg->writecomp.req_id = rc.req_id;
+        return msg;
+    }
+
+    volatile union SimbricksProtoMemM2H *msg = SimbricksMemIfM2HInPoll(&ch.memif, ts);
+    if (msg == nullptr or record_file == nullptr)
+        return msg;
+    switch (SimbricksMemIfM2HInType(&ch.memif, msg))
+    {
+    case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP:
+    {
+        uint8_t req_id = msg->readcomp.req_id;
+        uint32_t len = rchans[c].read_len[req_id];
+        record_event(c, REPLAY_READCOMP, ts);
+        replay_write_uleb(record_file, req_id);
+        replay_write_uleb(record_file, len);
+        fwrite(const_cast<uint8_t *>(msg->readcomp.data), 1, len, record_file);
+        break;
+    }
+    case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP:
+        record_event(c, REPLAY_WRITECOMP, ts);
+        replay_write_uleb(record_file, msg->writecomp.req_id & 0xff);
+        break;
+    }
+    return msg;
+}
+
+static inline uint8_t chan_in_type(mem_channel &ch, volatile union SimbricksProtoMemM2H *msg)
+{
+    if (replay_path != nullptr)
+    {
+        replay_kind kind = rchans[chan_index(ch)].kind;
+        return kind == REPLAY_READCOMP ? SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP : SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP;
+    }
+    return SimbricksMemIfM2HInType(&ch.memif, msg);
+}
+
+static inline void chan_in_done(mem_channel &ch, volatile union SimbricksProtoMemM2H *msg)
+{
+    if (replay_path != nullptr)
+    {
+        replay_msgs++;
+        replay_advance(chan_index(ch));
+        return;
+    }
+    SimbricksMemIfM2HInDone(&ch.memif, msg);
+}
+
+/* **************************************************************************
+ * memory transactions
+ *
+ * Every request the core issues on one of its memory ports gets an entry in a
+ * small transaction table, and the table index is used as the req_id on the
+ * memory channel. Completions may arrive in any order, responses are handed
+ * back to the core in request order per port, one per cycle.
+ * ************************************************************************** */
+
+enum mem_port : uint8_t {
+    PORT_INSTR,
+    PORT_DATA,
+    NUM_PORTS,
+};
+
+static const char *port_names[NUM_PORTS] = {"instr", "data"};
+
+enum txn_kind : uint8_t {
+    TXN_READ,   // read forwarded to the memory channel
+    TXN_WRITE,  // posted write, completes once sent
+    TXN_FILL,   // instruction cache line fill
+    TXN_MERGED, // fetch waiting for an outstanding line fill
+    TXN_LOCAL,  // answered by the adapter itself
+};
+
+enum txn_state : uint8_t {
+    TXN_FREE,
+    TXN_UNSENT, // channel was full, retry in the next cycle
+    TXN_ISSUED,
+    TXN_DONE,
+};
+
+struct mem_txn {
+    txn_state state;
+    txn_kind kind;
+    mem_port port;
+    uint8_t be;
+    uint16_t len;
+    uint32_t addr;     // word address requested by the core
+    uint32_t req_addr; // address sent on the memory channel
+    uint32_t data;     // write data or read result
+    uint64_t issue_ts;
+    uint64_t ready_cycle; // earliest cycle to return the response
+};
+
+#define TXN_TABLE_SIZE 16
+#define TXN_PORT_DEPTH (TXN_TABLE_SIZE / NUM_PORTS)
+
+struct port_queue {
+    uint8_t tags[TXN_PORT_DEPTH];
+    unsigned head;
+    unsigned count;
 
-        volatile struct SimbricksProtoMemH2MRead &read = msg->read;
-        read.addr = dut.data_addr_o;
-        read.req_id = DATA_REQ_ID;
-        read.len = 4; // TODO: bytes enabled
-        pending_data = true;
+    uint64_t completed;
+    uint64_t latency_sum; // ps between issue and completion
+    uint64_t depth_hist[TXN_PORT_DEPTH + 1];
+};
+
+static thread_local mem_txn txns[TXN_TABLE_SIZE];
+static thread_local unsigned txn_next = 0;
+static thread_local port_queue ports[NUM_PORTS];
+
+// channel the requests of a port are sent on
+static inline mem_channel &port_chan(mem_port port)
+{
+    return chans[num_chans > 1 and port == PORT_INSTR ? 1 : 0];
+}
+
+// the port can take another request in the next cycle
+static inline bool txn_port_ready(mem_port port)
+{
+    return ports[port].count < TXN_PORT_DEPTH;
+}
+
+static inline mem_txn &txn_port_entry(mem_port port, unsigned i)
+{
+    port_queue &q = ports[port];
+    return txns[q.tags[(q.head + i) % TXN_PORT_DEPTH]];
+}
+
+// cannot fail for a granted request, see txn_port_ready
+static mem_txn &txn_alloc(mem_port port, txn_kind kind, uint32_t addr)
+{
+    while (txns[txn_next].state != TXN_FREE)
+        txn_next = (txn_next + 1) % TXN_TABLE_SIZE;
+    uint8_t tag = txn_next;
+    txn_next = (txn_next + 1) % TXN_TABLE_SIZE;
+
+    port_queue &q = ports[port];
+    assert(q.count < TXN_PORT_DEPTH);
+    q.tags[(q.head + q.count) % TXN_PORT_DEPTH] = tag;
+    q.count++;
+
+    mem_txn &txn = txns[tag];
+    txn.state = TXN_UNSENT;
+    txn.kind = kind;
+    txn.port = port;
+    txn.addr = addr;
+    txn.req_addr = addr;
+    txn.len = 4;
+    txn.be = 0xf;
+    txn.issue_ts = main_time;
+    txn.ready_cycle = cur_cycle;
+    return txn;
+}
 
+static inline uint8_t txn_tag(const mem_txn &txn)
+{
+    return &txn - txns;
+}
+
+static bool txn_send(mem_channel &ch, uint64_t cur_ts, mem_txn &txn)
+{
+    volatile union SimbricksProtoMemH2M *msg = chan_out_alloc(ch, cur_ts);
+    if (msg == nullptr)
+    {
+#if IBEX_VERILATOR_DEBUG
+        sim_log::LogWarn("txn_send msg nullptr\n");
+#endif
+        stats.alloc_failures++;
+        return false;
+    }
+
+    if (txn.kind == TXN_WRITE)
+    {
+        volatile struct SimbricksProtoMemH2MWrite &write = msg->write;
+        write.addr = txn.req_addr;
+        write.req_id = txn_tag(txn);
+        write.len = txn.len;
+        memcpy(const_cast<uint8_t *>(write.data), &txn.data, txn.len);
 #if IBEX_VERILATOR_DEBUG
-        sim_log::LogInfo("[%lu] send_core_to_mem data read addr=%lx len=%u nullptr\n", main_time, dut.data_addr_o, 4);
+        sim_log::LogInfo("[%lu] txn_send %s write addr=%x len=%u\n", main_time, port_names[txn.port],
+                         txn.req_addr, txn.len);
         sim_log::FlushLog();
 #endif
-        SimbricksMemIfH2MOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
+        chan_out_send(ch, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
+        stats.h2m_writes++;
+        txn.state = TXN_DONE;
+        return true;
     }
-    // handel data write
-    else if (dut.data_req_o and dut.data_we_o and not pending_data)
+
+    volatile struct SimbricksProtoMemH2MRead &read = msg->read;
+    read.addr = txn.req_addr;
+    read.req_id = txn_tag(txn);
+    read.len = txn.len;
+#if IBEX_VERILATOR_DEBUG
+    sim_log::LogInfo("[%lu] txn_send %s read addr=%x len=%u\n", main_time, port_names[txn.port], txn.req_addr,
+                     txn.len);
+    sim_log::FlushLog();
+#endif
+    chan_out_send(ch, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
+    stats.h2m_reads++;
+    txn.state = TXN_ISSUED;
+    return true;
+}
+
+// writes out the write-combining buffer if it has to go first, see below
+static bool wcb_ready(uint64_t cur_ts);
+
+// send requests that did not fit into the channel earlier, in request order
+static void txn_send_unsent(uint64_t cur_ts)
+{
+    bool full[MAX_CHANNELS] = {};
+    full[&port_chan(PORT_DATA) - chans] = not wcb_ready(cur_ts);
+    for (int p = 0; p < NUM_PORTS; p++)
     {
-        if (dut.data_addr_o == 0x20008 && dut.data_wdata_o == 1) {
-            exiting = true;
-            return;
+        mem_channel &ch = port_chan(static_cast<mem_port>(p));
+        bool &ch_full = full[&ch - chans];
+        for (unsigned i = 0; i < ports[p].count and not ch_full; i++)
+        {
+            mem_txn &txn = txn_port_entry(static_cast<mem_port>(p), i);
+            if (txn.state == TXN_UNSENT and not txn_send(ch, cur_ts, txn))
+                ch_full = true;
         }
-        msg = SimbricksMemIfH2MOutAlloc(&memif, cur_ts);
-        if (msg == nullptr)
+    }
+}
+
+static void txn_complete(mem_txn &txn)
+{
+    txn.state = TXN_DONE;
+    if (txn.ready_cycle < cur_cycle)
+        txn.ready_cycle = cur_cycle;
+    port_queue &q = ports[txn.port];
+    q.completed++;
+    q.latency_sum += main_time - txn.issue_ts;
+}
+
+// request answered by the adapter itself after the given number of cycles
+static void txn_local(mem_port port, uint32_t addr, uint32_t data, uint32_t latency)
+{
+    mem_txn &txn = txn_alloc(port, TXN_LOCAL, addr);
+    txn.data = data;
+    txn.state = TXN_DONE;
+    txn.ready_cycle = cur_cycle + latency - 1;
+}
+
+// bit mask of the ports that waited for a response in the last txn_deliver
+static thread_local unsigned txn_stalled = 0;
+
+// hand the oldest finished response of each port to the core
+static void txn_deliver(delayed &delay)
+{
+    txn_stalled = 0;
+    for (int p = 0; p < NUM_PORTS; p++)
+    {
+        port_queue &q = ports[p];
+        q.depth_hist[q.count]++;
+        if (q.count == 0)
+            continue;
+        mem_txn &txn = txn_port_entry(static_cast<mem_port>(p), 0);
+        if (txn.state != TXN_DONE or txn.ready_cycle > cur_cycle)
         {
-    #if IBEX_VERILATOR_DEBUG
-            sim_log::LogWarn("send_core_to_mem msg nullptr\n");
-    #endif
-            return;
+            txn_stalled |= 1 << p;
+            if (p == PORT_INSTR)
+                stats.instr_stall_cycles++;
+            else
+                stats.data_stall_cycles++;
+            continue;
         }
 
-        volatile struct SimbricksProtoMemH2MWrite &write = msg->write;
-        write.addr = dut.data_addr_o;
-        write.req_id = DATA_WRITE_ID;
-        if (dut.data_be_o == 1)
-            write.len = 1;
-        else if (dut.data_be_o == 2)
-            write.len = 2;
+        if (p == PORT_INSTR)
+        {
+            delay.instr_rvalid_i = 1;
+            delay.instr_rdata_i = txn.data;
+        }
         else
-            write.len = 4;
-        memcpy(const_cast<uint8_t *>(write.data), &dut.data_wdata_o, write.len);
-
-#if IBEX_VERILATOR_DEBUG
-        sim_log::LogInfo("[%lu] send_core_to_mem data write addr=%lx len=%u nullptr\n", main_time, dut.data_addr_o, 4);
-        sim_log::FlushLog();
-#endif
-        SimbricksMemIfH2MOutSend(&memif, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
-        pending_data = true;
-        pending_data_write = true;
-    } else if (pending_data_write) {
-        // complete pending write from prior cycle
-        pending_data_write = false;
-        pending_data = false;
-        delay.data_rvalid_i = 1;
+        {
+            delay.data_rvalid_i = 1;
+            delay.data_rdata_i = txn.data;
+        }
+        txn.state = TXN_FREE;
+        q.head = (q.head + 1) % TXN_PORT_DEPTH;
+        q.count--;
     }
 }
 
-void poll_mem_to_core(struct SimbricksMemIf &memif, uint64_t cur_ts, Vibex_top &dut, delayed &delay)
+static void txn_print_stats()
+{
+    for (int p = 0; p < NUM_PORTS; p++)
+    {
+        port_queue &q = ports[p];
+        fprintf(stderr, "txn: port=%s completed=%lu avg_latency_ps=%.1f depth_hist=", port_names[p], q.completed,
+                q.completed ? double(q.latency_sum) / q.completed : 0.0);
+        for (unsigned d = 0; d <= TXN_PORT_DEPTH; d++)
+            fprintf(stderr, "%s%lu", d ? "," : "", q.depth_hist[d]);
+        fprintf(stderr, "\n");
+    }
+}
+
+/* **************************************************************************
+ * caches
+ *
+ * Optional direct-mapped caches in front of the memory channel. Misses fetch a
+ * whole line with a single read, hits are answered locally without touching
+ * the channel. The instruction cache covers all fetches. The data cache only
+ * covers loads from the ranges given with --cacheable and is write-through:
+ * stores update cached lines and still go to memory. Data writes update both
+ * caches so they stay coherent with stores from the core itself, but not
+ * with writes by other devices.
+ * ************************************************************************** */
+
+struct mem_cache {
+    uint32_t size = 0; // capacity in bytes, 0 disables the cache
+    uint32_t line_size = 32;
+    uint32_t hit_latency = 1; // cycles from grant to rvalid on a hit
+    uint32_t num_lines = 0;
+    std::vector<uint32_t> tags;
+    std::vector<bool> valid;
+    std::vector<uint8_t> data;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t fills = 0;
+    uint64_t write_updates = 0;
+};
+
+static thread_local mem_cache icache;
+static thread_local mem_cache dcache;
+
+// --cacheable ranges as first and last address, shared by all cores
+static std::vector<std::pair<uint32_t, uint32_t>> cacheable_ranges;
+
+static bool cache_init(mem_cache &c, const char *name, uint32_t max_line_size)
+{
+    if (c.line_size < 4 or (c.line_size & (c.line_size - 1)) != 0 or c.line_size > max_line_size)
+    {
+        fprintf(stderr, "%s: line size must be a power of two between 4 and %u\n", name, max_line_size);
+        return false;
+    }
+    if (c.size % c.line_size != 0)
+    {
+        fprintf(stderr, "%s: size must be a multiple of the line size\n", name);
+        return false;
+    }
+    if (c.hit_latency == 0)
+    {
+        fprintf(stderr, "%s: hit latency must be at least one cycle\n", name);
+        return false;
+    }
+    c.num_lines = c.size / c.line_size;
+    c.tags.assign(c.num_lines, 0);
+    c.valid.assign(c.num_lines, false);
+    c.data.assign(c.size, 0);
+    return true;
+}
+
+static inline uint32_t cache_line_addr(const mem_cache &c, uint32_t addr)
+{
+    return addr & ~(c.line_size - 1);
+}
+
+static inline uint32_t cache_index(const mem_cache &c, uint32_t line_addr)
+{
+    return (line_addr / c.line_size) % c.num_lines;
+}
+
+static bool cache_lookup(const mem_cache &c, uint32_t addr, uint32_t &word)
+{
+    uint32_t line_addr = cache_line_addr(c, addr);
+    uint32_t idx = cache_index(c, line_addr);
+    if (not c.valid[idx] or c.tags[idx] != line_addr)
+        return false;
+    memcpy(&word, &c.data[idx * c.line_size + (addr - line_addr)], 4);
+    return true;
+}
+
+static void cache_fill(mem_cache &c, uint32_t line_addr, const volatile uint8_t *src)
+{
+    uint32_t idx = cache_index(c, line_addr);
+    c.tags[idx] = line_addr;
+    c.valid[idx] = true;
+    memcpy(&c.data[idx * c.line_size], const_cast<uint8_t *>(src), c.line_size);
+    c.fills++;
+}
+
+// apply a store from the data port to a cached line, addr is word aligned
+static void cache_write(mem_cache &c, uint32_t addr, uint32_t wdata, uint8_t be)
+{
+    if (c.size == 0)
+        return;
+    uint32_t line_addr = cache_line_addr(c, addr);
+    uint32_t idx = cache_index(c, line_addr);
+    if (not c.valid[idx] or c.tags[idx] != line_addr)
+        return;
+    uint8_t *word = &c.data[idx * c.line_size + (addr - line_addr)];
+    for (int i = 0; i < 4; i++)
+    {
+        if (be & (1 << i))
+            word[i] = wdata >> (8 * i);
+    }
+    c.write_updates++;
+}
+
+static bool cacheable(uint32_t addr)
+{
+    for (const auto &[first, last] : cacheable_ranges)
+    {
+        if (addr >= first and addr <= last)
+            return true;
+    }
+    return false;
+}
+
+static bool cacheable_parse(const char *spec)
+{
+    char *end;
+    uint64_t base = strtoull(spec, &end, 0);
+    uint64_t size = *end == ':' ? strtoull(end + 1, &end, 0) : 0;
+    if (*end != 0 or size == 0 or base % 4 != 0 or size % 4 != 0 or base + size > (1ULL << 32))
+    {
+        fprintf(stderr, "cacheable: expected word aligned BASE:SIZE, got %s\n", spec);
+        return false;
+    }
+    cacheable_ranges.push_back({uint32_t(base), uint32_t(base + size - 1)});
+    return true;
+}
+
+static void cache_print_stats(const mem_cache &c, const char *name)
+{
+    uint64_t accesses = c.hits + c.misses;
+    fprintf(stderr, "%s: size=%u line=%u hits=%lu misses=%lu fills=%lu write_updates=%lu hit_rate=%.2f%%\n", name,
+            c.size, c.line_size, c.hits, c.misses, c.fills, c.write_updates,
+            accesses ? 100.0 * c.hits / accesses : 0.0);
+}
+
+/* **************************************************************************
+ * write combining
+ *
+ * Stores to --cacheable ranges can be collected in a write-combining buffer
+ * instead of leaving as one posted write each. The buffer holds one run of
+ * contiguous bytes inside an aligned block of --wcb-size bytes, so the byte,
+ * halfword and word stores of memset and memcpy loops become one write per
+ * block, and the core gets its response right away. The run is written out
+ * when a store does not extend it or fills the block, after --wcb-timeout
+ * cycles, when the core sleeps or retires a fence (rvfi variant), and ahead
+ * of every access that must not pass it: uncached data accesses including
+ * the adapter's own devices, stores that do not fit, and loads and fetches
+ * that overlap the buffered bytes. Other loads may pass the buffer.
+ *
+ * The buffer is only filled while no data request waits for room in the
+ * channel, so everything still unsent is younger than the buffered stores.
+ * ************************************************************************** */
+
+#define WCB_MAX_SIZE 64
+// the buffer's posted writes use a req_id outside the transaction table
+#define WCB_REQ_ID (TXN_TABLE_SIZE + 1)
+
+struct write_buffer {
+    uint32_t size = 0;     // --wcb-size, bytes per block, 0 disables the buffer
+    uint32_t timeout = 64; // --wcb-timeout, cycles
+    uint32_t start = 0;    // address of the first buffered byte
+    uint32_t len = 0;      // 0 if empty
+    uint64_t since = 0;    // cycle of the first buffered store
+    bool flush = false;    // write the run out before anything else is sent
+    uint8_t data[WCB_MAX_SIZE];
+
+    uint64_t stores = 0; // merged into the buffer
+    uint64_t writes = 0;
+    uint64_t bytes = 0;
+};
+
+static thread_local write_buffer wcb;
+
+static bool wcb_init(uint32_t max_write)
+{
+    if (wcb.size < 4 or (wcb.size & (wcb.size - 1)) != 0 or wcb.size > std::min<uint32_t>(WCB_MAX_SIZE, max_write))
+    {
+        fprintf(stderr, "wcb: size must be a power of two between 4 and %u\n",
+                std::min<uint32_t>(WCB_MAX_SIZE, max_write));
+        return false;
+    }
+    return true;
+}
+
+static inline bool wcb_overlaps(uint32_t addr, uint32_t len)
+{
+    return wcb.len != 0 and addr < uint64_t(wcb.start) + wcb.len and wcb.start < uint64_t(addr) + len;
+}
+
+// sends the buffered run, false if the channel is full
+static bool wcb_drain(uint64_t cur_ts)
+{
+    mem_channel &ch = port_chan(PORT_DATA);
+    volatile union SimbricksProtoMemH2M *msg = chan_out_alloc(ch, cur_ts);
+    if (msg == nullptr)
+    {
+        stats.alloc_failures++;
+        return false;
+    }
+    volatile struct SimbricksProtoMemH2MWrite &write = msg->write;
+    write.addr = wcb.start;
+    write.req_id = WCB_REQ_ID;
+    write.len = wcb.len;
+    memcpy(const_cast<uint8_t *>(write.data), wcb.data + (wcb.start & (wcb.size - 1)), wcb.len);
+    chan_out_send(ch, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
+    stats.h2m_writes++;
+    wcb.writes++;
+    wcb.bytes += wcb.len;
+    wcb.len = 0;
+    wcb.flush = false;
+    return true;
+}
+
+static bool wcb_ready(uint64_t cur_ts)
+{
+    return not wcb.flush or wcb_drain(cur_ts);
+}
+
+// adds a store with contiguous byte enables, false if it has to be sent on
+// its own behind the buffer
+static bool wcb_merge(uint32_t addr, uint8_t be, uint32_t wdata)
+{
+    if (wcb.flush)
+        return false;
+    for (unsigned i = 0; i < ports[PORT_DATA].count; i++)
+    {
+        if (txn_port_entry(PORT_DATA, i).state == TXN_UNSENT)
+            return false;
+    }
+
+    unsigned first = __builtin_ctz(be);
+    uint32_t start = addr + first;
+    uint32_t end = start + __builtin_popcount(be);
+    uint32_t mask = ~(wcb.size - 1);
+    if (wcb.len != 0 and
+        ((start & mask) != (wcb.start & mask) or start > wcb.start + wcb.len or end < wcb.start) and
+        not wcb_drain(main_time))
+    {
+        wcb.flush = true;
+        return false;
+    }
+    if (wcb.len == 0)
+    {
+        wcb.start = start;
+        wcb.len = end - start;
+        wcb.since = cur_cycle;
+    }
+    else
+    {
+        uint32_t run_end = std::max(end, wcb.start + wcb.len);
+        wcb.start = std::min(start, wcb.start);
+        wcb.len = run_end - wcb.start;
+    }
+    for (uint32_t a = start; a < end; a++)
+        wcb.data[a & (wcb.size - 1)] = wdata >> (8 * (a - addr));
+    wcb.stores++;
+    if (wcb.len == wcb.size)
+        wcb.flush = true;
+    return true;
+}
+
+static void wcb_print_stats()
+{
+    fprintf(stderr, "wcb: size=%u stores=%lu writes=%lu bytes_per_write=%.2f\n", wcb.size, wcb.stores, wcb.writes,
+            wcb.writes ? double(wcb.bytes) / wcb.writes : 0.0);
+}
+
+/* **************************************************************************
+ * memory-mapped devices
+ *
+ * Device registers the adapter answers itself instead of sending the access
+ * over the memory channel. Data accesses are looked up in a small table of
+ * address ranges before local memory and the channel. Each entry has an
+ * access function that is called with the offset into the range, and the
+ * number of cycles until the response. The table is rebuilt per core from the
+ * parsed options.
+ * ************************************************************************** */
+
+typedef uint32_t (*mmio_access_fn)(uint32_t offset, bool we, uint32_t wdata, uint8_t be);
+
+struct mmio_device {
+    const char *name;
+    uint32_t base;
+    uint32_t size;
+    uint32_t latency;
+    mmio_access_fn access;
+    uint64_t accesses = 0;
+};
+
+static thread_local std::vector<mmio_device> mmio_devices;
+
+static bool mmio_add(const char *name, uint32_t base, uint32_t size, uint32_t latency, mmio_access_fn access)
+{
+    for (const mmio_device &d : mmio_devices)
+    {
+        if (base < uint64_t(d.base) + d.size and d.base < uint64_t(base) + size)
+        {
+            fprintf(stderr, "mmio: %s at %x overlaps %s at %x\n", name, base, d.name, d.base);
+            return false;
+        }
+    }
+    mmio_devices.push_back({name, base, size, latency, access});
+    return true;
+}
+
+static inline mmio_device *mmio_lookup(uint32_t addr)
+{
+    for (mmio_device &d : mmio_devices)
+    {
+        if (addr - d.base < d.size)
+            return &d;
+    }
+    return nullptr;
+}
+
+static void mmio_print_stats()
+{
+    fprintf(stderr, "mmio:");
+    for (const mmio_device &d : mmio_devices)
+        fprintf(stderr, " %s=%lu", d.name, d.accesses);
+    fprintf(stderr, "\n");
+}
+
+/* **************************************************************************
+ * timer
+ *
+ * The mtime/mtimecmp timer of the Ibex simple system, implemented in the
+ * adapter so the firmware does not need a channel round trip per register
+ * access. mtime counts clock cycles and the timer interrupt is raised while
+ * mtime >= mtimecmp.
+ * ************************************************************************** */
+
+#define TIMER_MTIME 0x0
+#define TIMER_MTIMEH 0x4
+#define TIMER_MTIMECMP 0x8
+#define TIMER_MTIMECMPH 0xC
+#define TIMER_SIZE 0x10
+
+struct timer_dev {
+    bool enabled = true;
+    uint32_t base = 0x30000;
+    uint64_t mtime_offset = 0; // mtime - cur_cycle
+    uint64_t mtimecmp = 0;
+};
+
+static thread_local timer_dev timer;
+
+static inline uint32_t be_mask(uint8_t be)
+{
+    uint32_t mask = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        if (be & (1 << i))
+            mask |= 0xffU << (8 * i);
+    }
+    return mask;
+}
+
+static inline uint64_t timer_mtime()
+{
+    return cur_cycle + timer.mtime_offset;
+}
+
+static inline bool timer_irq()
+{
+    return timer.enabled and timer_mtime() >= timer.mtimecmp;
+}
+
+// cycle in which the interrupt will be raised next, UINT64_MAX if it already is
+static uint64_t timer_next_irq_cycle()
+{
+    if (not timer.enabled or timer_irq())
+        return UINT64_MAX;
+    return timer.mtimecmp - timer.mtime_offset;
+}
+
+static uint32_t timer_access(uint32_t offset, bool we, uint32_t wdata, uint8_t be)
+{
+    uint64_t mtime = timer_mtime();
+    uint64_t *reg = nullptr;
+    uint64_t val;
+    switch (offset)
+    {
+    case TIMER_MTIME:
+    case TIMER_MTIMEH:
+        reg = &mtime;
+        break;
+    case TIMER_MTIMECMP:
+    case TIMER_MTIMECMPH:
+        reg = &timer.mtimecmp;
+        break;
+    default:
+        return 0;
+    }
+
+    int shift = (offset & 0x4) ? 32 : 0;
+    val = *reg >> shift;
+    if (we)
+    {
+        uint64_t mask = uint64_t(be_mask(be)) << shift;
+        *reg = (*reg & ~mask) | ((uint64_t(wdata) << shift) & mask);
+        if (reg == &mtime)
+            timer.mtime_offset = mtime - cur_cycle;
+    }
+    return val;
+}
+
+/* **************************************************************************
+ * simulation control
+ *
+ * The control block of the Ibex simple system (SIM_CTRL_BASE in
+ * simple_system_regs.h). A write of 1 to the control register halts the
+ * simulation. With --console the character output register is served here as
+ * well and the output is written to a host file in blocks, instead of one
+ * posted write per character to a terminal device on the interconnect.
+ * ************************************************************************** */
+
+#define SIM_CTRL_OUT 0x0
+#define SIM_CTRL_CTRL 0x8
+#define CONSOLE_BUF_SIZE 4096
+
+struct sim_ctrl_dev {
+    uint32_t base = 0x20000;
+    const char *console_path = nullptr; // --console, "-" is stdout
+    FILE *console = nullptr;
+    char buf[CONSOLE_BUF_SIZE];
+    size_t buf_len = 0;
+};
+
+static thread_local sim_ctrl_dev sim_ctrl;
+
+static void console_flush()
+{
+    if (sim_ctrl.buf_len == 0)
+        return;
+    fwrite(sim_ctrl.buf, 1, sim_ctrl.buf_len, sim_ctrl.console);
+    fflush(sim_ctrl.console);
+    sim_ctrl.buf_len = 0;
+}
+
+static uint32_t console_access([[maybe_unused]] uint32_t offset, bool we, uint32_t wdata, uint8_t be)
+{
+    if (we and (be & 1))
+    {
+        sim_ctrl.buf[sim_ctrl.buf_len++] = wdata;
+        if (sim_ctrl.buf_len == CONSOLE_BUF_SIZE)
+            console_flush();
+    }
+    return 0;
+}
+
+static uint32_t halt_access([[maybe_unused]] uint32_t offset, bool we, uint32_t wdata, uint8_t be)
+{
+    if (we and (be & 1) and (wdata & 1) and not halted)
+    {
+        halted = true;
+        if (cores_halted.fetch_add(1) + 1 == num_cores)
+            exiting = true;
+    }
+    return 0;
+}
+
+static bool console_open()
+{
+    if (sim_ctrl.console_path == nullptr)
+        return true;
+    if (strcmp(sim_ctrl.console_path, "-") == 0)
+    {
+        sim_ctrl.console = stdout;
+        return true;
+    }
+    sim_ctrl.console = fopen(core_file_path(sim_ctrl.console_path).c_str(), "w");
+    if (sim_ctrl.console == nullptr)
+    {
+        perror("opening console file failed");
+        return false;
+    }
+    return true;
+}
+
+static void console_close()
+{
+    if (sim_ctrl.console == nullptr)
+        return;
+    console_flush();
+    if (sim_ctrl.console != stdout)
+        fclose(sim_ctrl.console);
+    sim_ctrl.console = nullptr;
+}
+
+// the devices the adapter answers for the current core
+static bool mmio_setup()
+{
+    if (timer.enabled and not mmio_add("timer", timer.base, TIMER_SIZE, 1, timer_access))
+        return false;
+    if (not mmio_add("halt", sim_ctrl.base + SIM_CTRL_CTRL, 4, 1, halt_access))
+        return false;
+    if (sim_ctrl.console_path != nullptr and
+        not mmio_add("console", sim_ctrl.base + SIM_CTRL_OUT, 4, 1, console_access))
+        return false;
+    return console_open();
+}
+
+/* **************************************************************************
+ * local memory
+ *
+ * Address ranges declared with --local-mem are backed by memory inside the
+ * adapter process and accesses to them never go over the memory channel. This
+ * is only correct as long as no other simulator accesses these ranges. With
+ * several cores each one has its own copy.
+ * ************************************************************************** */
+
+struct local_region {
+    uint32_t base;
+    uint32_t size;
+    uint8_t *mem;
+};
+
+static thread_local std::vector<local_region> local_regions;
+static uint32_t local_mem_latency = 1;
+// --local-mem and --local-elf arguments, every core sets up its own copy
+static std::vector<const char *> local_mem_specs;
+static const char *local_elf = nullptr;
+
+// BASE:SIZE[:IMAGE], the optional raw image is mapped copy-on-write at BASE
+static bool local_mem_add(const char *spec)
+{
+    char *end;
+    uint64_t base = strtoull(spec, &end, 0);
+    uint64_t size = *end == ':' ? strtoull(end + 1, &end, 0) : 0;
+    if ((*end != ':' and *end != 0) or size == 0 or base % 4 != 0 or size % 4 != 0 or base + size > (1ULL << 32))
+    {
+        fprintf(stderr, "local-mem: expected word aligned BASE:SIZE[:IMAGE], got %s\n", spec);
+        return false;
+    }
+    const char *image = *end == ':' ? end + 1 : nullptr;
+
+    for (local_region &r : local_regions)
+    {
+        if (base < uint64_t(r.base) + r.size and r.base < base + size)
+        {
+            fprintf(stderr, "local-mem: %s overlaps another region\n", spec);
+            return false;
+        }
+    }
+
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED)
+    {
+        perror("local-mem: mmap failed");
+        return false;
+    }
+
+    if (image != nullptr)
+    {
+        int fd = open(image, O_RDONLY);
+        struct stat st;
+        if (fd < 0 or fstat(fd, &st) != 0)
+        {
+            perror("local-mem: opening image failed");
+            return false;
+        }
+        if (uint64_t(st.st_size) > size)
+        {
+            fprintf(stderr, "local-mem: image %s is larger than the region\n", image);
+            close(fd);
+            return false;
+        }
+        if (st.st_size > 0 and
+            mmap(mem, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+        {
+            perror("local-mem: mapping image failed");
+            close(fd);
+            return false;
+        }
+        close(fd);
+    }
+
+    local_regions.push_back({uint32_t(base), uint32_t(size), static_cast<uint8_t *>(mem)});
+    return true;
+}
+
+// copy the loadable segments of an ELF file into the local regions covering them
+static bool local_mem_load_elf(const char *path)
+{
+    elf_image img;
+    if (not elf_read(path, img))
+        return false;
+    for (const elf_segment &seg : img.segments)
+    {
+        local_region *region = nullptr;
+        for (local_region &r : local_regions)
+        {
+            if (seg.addr >= r.base and uint64_t(seg.addr) + seg.memsz <= uint64_t(r.base) + r.size)
+                region = &r;
+        }
+        if (region == nullptr)
+        {
+            fprintf(stderr, "local-mem: segment at %x is not in a local region, leaving it to the memory device\n",
+                    seg.addr);
+            continue;
+        }
+        memcpy(region->mem + (seg.addr - region->base), seg.data, seg.filesz);
+    }
+    return true;
+}
+
+// host address of a word in local memory, or nullptr if it is not local
+static inline uint8_t *local_mem_lookup(uint32_t addr)
+{
+    for (local_region &r : local_regions)
+    {
+        if (addr - r.base < r.size)
+            return r.mem + (addr - r.base);
+    }
+    return nullptr;
+}
+
+// read through the cache of a port: hits are answered locally, a miss fills
+// the line or waits for an outstanding fill of the same line
+static void txn_cached_read(mem_port port, mem_cache &c, uint32_t addr)
+{
+    uint32_t word;
+    if (cache_lookup(c, addr, word))
+    {
+        c.hits++;
+        txn_local(port, addr, word, c.hit_latency);
+        return;
+    }
+
+    c.misses++;
+    uint32_t line_addr = cache_line_addr(c, addr);
+    if (wcb_overlaps(line_addr, c.line_size))
+        wcb.flush = true;
+    for (unsigned i = 0; i < ports[port].count; i++)
+    {
+        mem_txn &fill = txn_port_entry(port, i);
+        if (fill.kind == TXN_FILL and fill.state != TXN_DONE and fill.req_addr == line_addr)
+        {
+            txn_alloc(port, TXN_MERGED, addr).state = TXN_ISSUED;
+            return;
+        }
+    }
+    mem_txn &txn = txn_alloc(port, TXN_FILL, addr);
+    txn.req_addr = line_addr;
+    txn.len = c.line_size;
+}
+
+// narrows a word access to the enabled bytes, Ibex only produces contiguous
+// byte enables (misaligned accesses are split into two words)
+static inline void txn_bytes(mem_txn &txn, uint8_t be)
+{
+    txn.be = be;
+    txn.req_addr = txn.addr + __builtin_ctz(be);
+    txn.len = __builtin_popcount(be);
+}
+
+static void issue_instr_req(Vibex_top &dut)
+{
+    uint32_t addr = dut.instr_addr_o;
+    uint32_t word;
+    if (uint8_t *local = local_mem_lookup(addr))
+    {
+        memcpy(&word, local, 4);
+        txn_local(PORT_INSTR, addr, word, local_mem_latency);
+        return;
+    }
+    if (icache.size != 0)
+    {
+        txn_cached_read(PORT_INSTR, icache, addr);
+        return;
+    }
+    if (wcb_overlaps(addr, 4))
+        wcb.flush = true;
+    txn_alloc(PORT_INSTR, TXN_READ, addr);
+}
+
+static void issue_data_req(Vibex_top &dut)
+{
+    uint32_t addr = dut.data_addr_o;
+    uint8_t be = dut.data_be_o;
+    if (mmio_device *dev = mmio_lookup(addr))
+    {
+        // device accesses stay behind the buffered stores
+        if (wcb.len != 0)
+            wcb.flush = true;
+        dev->accesses++;
+        uint32_t rdata = dev->access(addr - dev->base, dut.data_we_o, dut.data_wdata_o, be);
+        txn_local(PORT_DATA, addr, rdata, dev->latency);
+        return;
+    }
+    if (uint8_t *local = local_mem_lookup(addr))
+    {
+        uint32_t word;
+        if (dut.data_we_o)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                if (be & (1 << i))
+                    local[i] = dut.data_wdata_o >> (8 * i);
+            }
+        }
+        memcpy(&word, local, 4);
+        txn_local(PORT_DATA, addr, word, local_mem_latency);
+        return;
+    }
+
+    bool cached = not cacheable_ranges.empty() and cacheable(addr);
+    if (not cached and wcb.len != 0)
+        wcb.flush = true;
+    if (not dut.data_we_o)
+    {
+        if (cached and dcache.size != 0)
+        {
+            txn_cached_read(PORT_DATA, dcache, addr);
+            return;
+        }
+        if (wcb_overlaps(addr, 4))
+            wcb.flush = true;
+        txn_bytes(txn_alloc(PORT_DATA, TXN_READ, addr), be);
+        return;
+    }
+
+    // write-through, the cached copies are updated right away
+    cache_write(icache, addr, dut.data_wdata_o, be);
+    cache_write(dcache, addr, dut.data_wdata_o, be);
+    if (cached and wcb.size != 0 and wcb_merge(addr, be, dut.data_wdata_o))
+    {
+        txn_local(PORT_DATA, addr, 0, 1);
+        return;
+    }
+    if (wcb.len != 0)
+        wcb.flush = true;
+    mem_txn &txn = txn_alloc(PORT_DATA, TXN_WRITE, addr);
+    txn_bytes(txn, be);
+    txn.data = dut.data_wdata_o >> (8 * (txn.req_addr - addr));
+}
+
+void send_core_to_mem(uint64_t cur_ts, Vibex_top &dut, delayed &delay)
+{
+    delay.instr_rvalid_i = 0;
+    delay.data_rvalid_i = 0;
+
+    // requests are accepted on the coming rising edge, the grants were set up
+    // after the previous one
+    if (dut.instr_req_o and dut.instr_gnt_i)
+    {
+        issue_instr_req(dut);
+    }
+    if (dut.data_req_o and dut.data_gnt_i)
+    {
+        issue_data_req(dut);
+    }
+    if (wcb.len != 0 and (dut.core_sleep_o or cur_cycle - wcb.since >= wcb.timeout))
+        wcb.flush = true;
+
+    txn_send_unsent(cur_ts);
+}
+
+// reads of the fast-forward simulator use a req_id outside the transaction table
+#define FF_REQ_ID TXN_TABLE_SIZE
+static void ff_read_complete(const volatile uint8_t *data);
+
+// handles one message from the memory side, returns false if none was ready
+bool poll_mem_to_core(mem_channel &ch, uint64_t cur_ts)
+{
+    stats.polls++;
+    volatile union SimbricksProtoMemM2H *msg = chan_in_poll(ch, cur_ts);
+    if (msg == nullptr)
+    {
+#if IBEX_VERILATOR_DEBUG
+//      sim_log::LogWarn("poll_mem_to_core msg nullptr\n");
+#endif
+        stats.empty_polls++;
+        return false;
+    }
+
+    uint8_t type = chan_in_type(ch, msg);
+    switch (type)
+    {
+    case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP:
+    {
+        volatile struct SimbricksProtoMemM2HReadcomp &readcomp = msg->readcomp;
+        uint64_t tag = readcomp.req_id;
+        stats.m2h_readcomps++;
+        if (tag == FF_REQ_ID)
+        {
+            ff_read_complete(readcomp.data);
+            break;
+        }
+        if (tag >= TXN_TABLE_SIZE or txns[tag].state != TXN_ISSUED or &port_chan(txns[tag].port) != &ch)
+        {
+            sim_log::LogError("poll_mem_to_core: unexpected completion req_id=%lu\n", tag);
+            if (replay_path != nullptr)
+                replay_fail("completion for a request that is not outstanding");
+            break;
+        }
+
+        mem_txn &txn = txns[tag];
+        if (txn.kind == TXN_FILL)
+        {
+            mem_cache &c = txn.port == PORT_INSTR ? icache : dcache;
+            cache_fill(c, txn.req_addr, readcomp.data);
+            cache_lookup(c, txn.addr, txn.data);
+            txn_complete(txn);
+
+            // accesses to the same line that were waiting for this fill
+            for (unsigned i = 0; i < ports[txn.port].count; i++)
+            {
+                mem_txn &merged = txn_port_entry(txn.port, i);
+                if (merged.kind == TXN_MERGED and merged.state == TXN_ISSUED and
+                    cache_line_addr(c, merged.addr) == txn.req_addr)
+                {
+                    cache_lookup(c, merged.addr, merged.data);
+                    txn_complete(merged);
+                }
+            }
+        }
+        else
+        {
+            // the enabled bytes at their place in the word
+            txn.data = 0;
+            memcpy(reinterpret_cast<uint8_t *>(&txn.data) + (txn.req_addr - txn.addr),
+                   const_cast<uint8_t *>(readcomp.data), txn.len);
+            txn_complete(txn);
+        }
+#if IBEX_VERILATOR_DEBUG
+        sim_log::LogInfo("[%lu] poll_mem_to_core %s read complete addr=%x (%x)\n", main_time,
+                         port_names[txn.port], txn.addr, txn.data);
+        sim_log::FlushLog();
+#endif
+        break;
+    }
+    case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP:
+        // NOTE: currently we only support posted writes
+        stats.m2h_writecomps++;
+        break;
+    case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
+        stats.m2h_syncs++;
+        break;
+    default:
+        sim_log::LogError("poll_mem_to_core: unsupported type=%d", type);
+    }
+
+    chan_in_done(ch, msg);
+    return true;
+}
+
+/* **************************************************************************
+ * channel scheduling
+ *
+ * Messages on a memory channel arrive in timestamp order. Once the adapter
+ * has seen the timestamp of the next inbound message in synchronized mode,
+ * nothing can arrive before it, and an outbound sync is only due once per
+ * sync interval. The main loop therefore only syncs and polls when one of
+ * these points is reached and then drains every message that is due; the
+ * cycles in between evaluate the model and send new requests only. Each
+ * channel keeps its own due points.
+ * ************************************************************************** */
+
+static bool chan_batch = true; // skip channel work between due points
+
+static void chan_sync(mem_channel &ch)
+{
+    if (main_time < chan_out_next_sync(ch))
+    {
+        ch.next_sync = chan_batch ? chan_out_next_sync(ch) : 0;
+        return;
+    }
+    stats.h2m_syncs++;
+    while (chan_out_sync(ch, main_time) != 0)
+    {
+        sim_log::LogError("warn: SimbricksMemIfH2MOutSync failed on %s (t=%lu)\n", ch.name, main_time);
+    }
+    // messages sent later only push the next sync further out
+    ch.next_sync = chan_batch ? chan_out_next_sync(ch) : 0;
+}
+
+// handle all messages due at main_time, in synchronized mode wait until the
+// peer is ahead of us
+static void chan_drain(mem_channel &ch)
+{
+    while (not exiting)
+    {
+        if (poll_mem_to_core(ch, main_time))
+            continue;
+        if (not ch.sync or chan_in_timestamp(ch) > main_time)
+            break;
+    }
+    ch.next_poll = chan_batch and ch.sync ? chan_in_timestamp(ch) : 0;
+}
+
+/* **************************************************************************
+ * sleep fast-forward
+ *
+ * While Ibex sleeps in WFI its core clock is gated, so nothing in the model
+ * changes until one of its inputs does. With no memory transaction in flight
+ * the adapter skips whole cycles without evaluating the model, up to the next
+ * point where an input can change or the memory channel needs attention.
+ * ************************************************************************** */
+
+// cycles skipped at once without synchronization, bounds how late incoming
+// messages are noticed
+#define WFI_MAX_SKIP_CYCLES 1024
+
+static bool wfi_skip = true;
+static thread_local uint64_t wfi_skips = 0;
+static thread_local uint64_t wfi_skipped_cycles = 0;
+
+static uint64_t time_event_next();
+
+static bool wfi_idle(Vibex_top &dut)
+{
+    if (not dut.core_sleep_o or dut.instr_rvalid_i or dut.data_rvalid_i or wcb.len != 0)
+        return false;
+    for (int p = 0; p < NUM_PORTS; p++)
+    {
+        if (ports[p].count != 0)
+            return false;
+    }
+    return true;
+}
+
+static void wfi_fast_forward(uint64_t clock_period)
+{
+    uint64_t cycles = UINT64_MAX;
+    for (unsigned c = 0; c < num_chans; c++)
+    {
+        if (not chans[c].sync)
+        {
+            cycles = std::min<uint64_t>(cycles, WFI_MAX_SKIP_CYCLES);
+            continue;
+        }
+        // stay behind the next message from the peer and send our syncs in time
+        uint64_t target = std::min(chan_in_timestamp(chans[c]), chan_out_next_sync(chans[c]));
+        cycles = std::min(cycles, target > main_time ? (target - main_time) / clock_period : 0);
+    }
+    uint64_t timer_cycle = timer_next_irq_cycle();
+    if (timer_cycle != UINT64_MAX)
+        cycles = std::min(cycles, timer_cycle - cur_cycle);
+    // the cycle after the skip reaches a pending checkpoint or trace window edge
+    uint64_t event_time = time_event_next();
+    if (event_time != UINT64_MAX)
+        cycles = std::min(cycles, (event_time - main_time - 1) / clock_period);
+    if (cycles == 0)
+        return;
+
+    main_time += cycles * clock_period;
+    cur_cycle += cycles;
+    for (int p = 0; p < NUM_PORTS; p++)
+        ports[p].depth_hist[0] += cycles;
+    wfi_skips++;
+    wfi_skipped_cycles += cycles;
+}
+
+/* **************************************************************************
+ * functional fast-forward
+ *
+ * Runs the program on the instruction-set simulator in rv32_iss.cpp instead
+ * of the model until a PC, an instruction count or a simulated time is
+ * reached, then continues cycle-accurately in the model. While the simulator
+ * runs, the model is not evaluated and every instruction counts as one
+ * cycle. Memory accesses go to the MMIO devices, local memory and the memory
+ * channel like those of the model, so stores are visible to the model
+ * without a separate transfer. Simulated time advances in bursts up to the
+ * next point where a channel needs attention.
+ *
+ * The architectural state moves into the model through the Ibex debug mode.
+ * The adapter serves a small program at the debug halt address from local
+ * memory and raises debug_req_i. The program loads the CSRs, dpc and the
+ * registers from a block next to it and returns with dret. With a sampling
+ * window the way back works the same: the program stores the state to the
+ * block and waits there while the simulator runs, so windows of detailed
+ * simulation alternate with functional periods.
+ * ************************************************************************** */
+
+#define FF_STUB_SIZE 0x800
+#define FF_BLOCK 0x400 // offset of the state block in the stub region
+#define FF_MAX_BURST 1024 // cycles between checks without synchronized channels
+#define FF_READS 4 // channel reads of one instruction: two fetches, two loads
+
+// words of the state block
+enum {
+    FF_CMD,    // written by the adapter: 0 saves the state, 1 restores it
+    FF_STATUS, // written by the stub program
+    FF_PC,
+    FF_CSRS,
+};
+
+enum {
+    FF_STATUS_SAVED = 1,
+    FF_STATUS_RESTORING = 2,
+};
+
+static const uint32_t ff_csrs[] = {
+    RV32_CSR_MSTATUS, RV32_CSR_MIE,    RV32_CSR_MTVEC,  RV32_CSR_MSCRATCH,  RV32_CSR_MEPC,     RV32_CSR_MCAUSE,
+    RV32_CSR_MTVAL,   RV32_CSR_MCYCLE, RV32_CSR_MCYCLEH, RV32_CSR_MINSTRET, RV32_CSR_MINSTRETH,
+    RV32_CSR_MCOUNTINHIBIT,
+};
+#define FF_NUM_CSRS (sizeof(ff_csrs) / sizeof(ff_csrs[0]))
+#define FF_REGS (FF_CSRS + FF_NUM_CSRS)
+
+enum ff_mode {
+    FF_OFF,    // detailed simulation only
+    FF_ISS,    // the simulator runs, the model is parked
+    FF_TO_RTL, // the model loads the state
+    FF_RTL,    // detailed sampling window
+    FF_TO_ISS, // the model stores the state
+};
+
+struct ff_config {
+    uint64_t insns = 0;               // --ff-insns, 0 if not set
+    bool until_pc_set = false;
+    uint32_t until_pc = 0;            // --ff-until-pc
+    uint64_t until_time = UINT64_MAX; // --ff-until
+    uint64_t window = 0;              // --ff-window, detailed cycles per sample
+    uint64_t period = 0;              // --ff-period, instructions between samples
+    uint32_t dm_addr = 0x1a110800;    // DmHaltAddr of ibex_top
+
+    bool enabled() const
+    {
+        return insns != 0 or until_pc_set or until_time != UINT64_MAX or window != 0;
+    }
+};
+
+// a channel read of the simulator, identified by FF_REQ_ID on the channel
+struct ff_read {
+    uint32_t addr;
+    uint32_t req_addr; // line address of a cache fill
+    uint32_t len;
+    bool done;
+    uint32_t data;
+};
+
+struct ff_state {
+    ff_mode mode = FF_OFF;
+    uint64_t next_check = UINT64_MAX; // cycle of the next ff_poll
+    bool parked = false;              // the model waits in the stub program
+    bool until_pc = false;            // stop at cfg.until_pc, only in the first period
+    uint64_t iss_end = UINT64_MAX;    // insns at which the period ends
+    rv32_state iss;
+    uint8_t stub[FF_STUB_SIZE];
+
+    ff_read reads[FF_READS];
+    unsigned num_reads = 0;
+    bool read_pending = false;
+    bool sleeping = false; // retired a WFI, waits for an enabled interrupt
+
+    uint64_t insns = 0;
+    uint64_t cycles = 0;
+    uint64_t rtl_cycles = 0; // in sampling windows
+    uint64_t handoffs = 0;
+    uint64_t rtl_start = 0;
+};
+
+static ff_config ff_cfg;
+static thread_local ff_state ff;
+
+static inline uint32_t &ff_word(unsigned idx)
+{
+    return reinterpret_cast<uint32_t *>(ff.stub + FF_BLOCK)[idx];
+}
+
+// assembles the save/restore program at the debug halt address
+static void ff_stub_init()
+{
+    std::vector<uint32_t> code;
+    uint32_t block = ff_cfg.dm_addr + FF_BLOCK;
+    uint32_t block_hi = (block + 0x800) & ~0xfffU;
+    auto off = [](unsigned word) { return int32_t(word * 4); };
+    auto here = [&code] { return int32_t(code.size() * 4); };
+
+    code.push_back(rv32_jal(0, 0x10)); // halt address
+    code.push_back(rv32_addi(0, 0, 0));
+    code.push_back(rv32_jal(0, 0)); // exception address, reported by ff_poll
+    code.push_back(rv32_addi(0, 0, 0));
+    code.push_back(rv32_csrw(RV32_CSR_DSCRATCH0, 1));
+    code.push_back(rv32_csrw(RV32_CSR_DSCRATCH1, 2));
+    code.push_back(rv32_lui(1, block_hi));
+    code.push_back(rv32_addi(1, 1, int32_t(block - block_hi)));
+    code.push_back(rv32_lw(2, off(FF_CMD), 1));
+    size_t branch_restore = code.size();
+    code.push_back(0);
+
+    // save
+    for (unsigned r = 3; r < 32; r++)
+        code.push_back(rv32_sw(r, off(FF_REGS + r), 1));
+    code.push_back(rv32_csrr(2, RV32_CSR_DSCRATCH0));
+    code.push_back(rv32_sw(2, off(FF_REGS + 1), 1));
+    code.push_back(rv32_csrr(2, RV32_CSR_DSCRATCH1));
+    code.push_back(rv32_sw(2, off(FF_REGS + 2), 1));
+    code.push_back(rv32_csrr(2, RV32_CSR_DPC));
+    code.push_back(rv32_sw(2, off(FF_PC), 1));
+    for (unsigned i = 0; i < FF_NUM_CSRS; i++)
+    {
+        code.push_back(rv32_csrr(2, ff_csrs[i]));
+        code.push_back(rv32_sw(2, off(FF_CSRS + i), 1));
+    }
+    code.push_back(rv32_addi(2, 0, FF_STATUS_SAVED));
+    code.push_back(rv32_sw(2, off(FF_STATUS), 1));
+    // park until the adapter asks for a restore
+    code.push_back(rv32_lw(2, off(FF_CMD), 1));
+    code.push_back(rv32_beq(2, 0, -4));
+
+    // restore
+    int32_t restore = here();
+    code[branch_restore] = rv32_bne(2, 0, restore - int32_t(branch_restore * 4));
+    code.push_back(rv32_addi(2, 0, FF_STATUS_RESTORING));
+    code.push_back(rv32_sw(2, off(FF_STATUS), 1));
+    for (unsigned i = 0; i < FF_NUM_CSRS; i++)
+    {
+        code.push_back(rv32_lw(2, off(FF_CSRS + i), 1));
+        code.push_back(rv32_csrw(ff_csrs[i], 2));
+    }
+    code.push_back(rv32_lw(2, off(FF_PC), 1));
+    code.push_back(rv32_csrw(RV32_CSR_DPC, 2));
+    for (unsigned r = 3; r < 32; r++)
+        code.push_back(rv32_lw(r, off(FF_REGS + r), 1));
+    code.push_back(rv32_lw(2, off(FF_REGS + 2), 1));
+    code.push_back(rv32_lw(1, off(FF_REGS + 1), 1));
+    code.push_back(RV32_DRET);
+
+    assert(code.size() * 4 <= FF_BLOCK and (FF_REGS + 32) * 4 <= FF_STUB_SIZE - FF_BLOCK);
+    memset(ff.stub, 0, sizeof(ff.stub));
+    memcpy(ff.stub, code.data(), code.size() * 4);
+}
+
+// serves the program at the debug halt address
+static bool ff_stub_map()
+{
+    for (local_region &r : local_regions)
+    {
+        if (ff_cfg.dm_addr < uint64_t(r.base) + r.size and r.base < uint64_t(ff_cfg.dm_addr) + FF_STUB_SIZE)
+        {
+            fprintf(stderr, "ff: debug halt address %x overlaps a local region\n", ff_cfg.dm_addr);
+            return false;
+        }
+    }
+    ff_stub_init();
+    local_regions.push_back({ff_cfg.dm_addr, FF_STUB_SIZE, ff.stub});
+    return true;
+}
+
+static bool ff_setup(uint32_t hart_id)
+{
+    if (not ff_cfg.enabled())
+        return true;
+    if (not ff_stub_map())
+        return false;
+
+    // Ibex reset state
+    ff.iss = rv32_state();
+    ff.iss.pc = (IBEX_BOOT_ADDR & ~0xffU) | 0x80;
+    ff.iss.mtvec = (IBEX_BOOT_ADDR & ~0xffU) | 1;
+    ff.iss.mhartid = hart_id;
+    ff.until_pc = ff_cfg.until_pc_set;
+    ff.iss_end = ff_cfg.insns ? ff_cfg.insns
+                 : ff.until_pc or ff_cfg.until_time != UINT64_MAX ? UINT64_MAX
+                                                                   : ff_cfg.period;
+    ff.mode = FF_ISS;
+    return true;
+}
+
+// retires the finished reads of the last instruction, keeps one in flight
+static void ff_reads_retire()
+{
+    unsigned n = 0;
+    for (unsigned i = 0; i < ff.num_reads; i++)
+    {
+        if (not ff.reads[i].done)
+            ff.reads[n++] = ff.reads[i];
+    }
+    ff.num_reads = n;
+}
+
+static void ff_read_complete(const volatile uint8_t *data)
+{
+    for (unsigned i = 0; i < ff.num_reads; i++)
+    {
+        ff_read &rd = ff.reads[i];
+        if (rd.done)
+            continue;
+        if (rd.len > 4)
+            cache_fill(icache, rd.req_addr, data);
+        memcpy(&rd.data, const_cast<const uint8_t *>(data) + (rd.addr - rd.req_addr), 4);
+        rd.done = true;
+        break;
+    }
+    ff.read_pending = false;
+}
+
+// one word over the channel, len > 4 fills the instruction cache line
+static rv32_mem ff_channel_read(mem_port port, uint32_t addr, uint32_t req_addr, uint32_t len, uint32_t &word)
+{
+    for (unsigned i = 0; i < ff.num_reads; i++)
+    {
+        ff_read &rd = ff.reads[i];
+        if (rd.addr != addr)
+            continue;
+        if (not rd.done)
+            return RV32_MEM_RETRY;
+        word = rd.data;
+        return RV32_MEM_OK;
+    }
+    if (ff.read_pending or ff.num_reads == FF_READS)
+        return RV32_MEM_RETRY;
+
+    mem_channel &ch = port_chan(port);
+    volatile union SimbricksProtoMemH2M *msg = chan_out_alloc(ch, main_time);
+    if (msg == nullptr)
+    {
+        stats.alloc_failures++;
+        return RV32_MEM_RETRY;
+    }
+    volatile struct SimbricksProtoMemH2MRead &read = msg->read;
+    read.addr = req_addr;
+    read.req_id = FF_REQ_ID;
+    read.len = len;
+    chan_out_send(ch, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_READ);
+    stats.h2m_reads++;
+    ff.reads[ff.num_reads++] = {addr, req_addr, len, false, 0};
+    ff.read_pending = true;
+    return RV32_MEM_RETRY;
+}
+
+static rv32_mem ff_fetch(uint32_t addr, uint32_t &word)
+{
+    if (uint8_t *local = local_mem_lookup(addr))
+    {
+        memcpy(&word, local, 4);
+        return RV32_MEM_OK;
+    }
+    if (icache.size == 0)
+        return ff_channel_read(PORT_INSTR, addr, addr, 4, word);
+    if (cache_lookup(icache, addr, word))
+        return RV32_MEM_OK;
+    return ff_channel_read(PORT_INSTR, addr, cache_line_addr(icache, addr), icache.line_size, word);
+}
+
+static rv32_mem ff_load(uint32_t addr, uint8_t be, uint32_t &word)
+{
+    if (mmio_device *dev = mmio_lookup(addr))
+    {
+        dev->accesses++;
+        word = dev->access(addr - dev->base, false, 0, be);
+        return RV32_MEM_OK;
+    }
+    if (uint8_t *local = local_mem_lookup(addr))
+    {
+        memcpy(&word, local, 4);
+        return RV32_MEM_OK;
+    }
+    return ff_channel_read(PORT_DATA, addr, addr, 4, word);
+}
+
+static rv32_mem ff_store(uint32_t addr, uint8_t be, uint32_t word)
+{
+    if (mmio_device *dev = mmio_lookup(addr))
+    {
+        dev->accesses++;
+        dev->access(addr - dev->base, true, word, be);
+        return RV32_MEM_OK;
+    }
+    if (uint8_t *local = local_mem_lookup(addr))
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (be & (1 << i))
+                local[i] = word >> (8 * i);
+        }
+        return RV32_MEM_OK;
+    }
+
+    // the simulator only produces contiguous byte enables
+    mem_channel &ch = port_chan(PORT_DATA);
+    volatile union SimbricksProtoMemH2M *msg = chan_out_alloc(ch, main_time);
+    if (msg == nullptr)
+    {
+        stats.alloc_failures++;
+        return RV32_MEM_RETRY;
+    }
+    unsigned first = __builtin_ctz(be);
+    volatile struct SimbricksProtoMemH2MWrite &write = msg->write;
+    write.addr = addr + first;
+    write.req_id = FF_REQ_ID;
+    write.len = __builtin_popcount(be);
+    uint32_t data = word >> (8 * first);
+    memcpy(const_cast<uint8_t *>(write.data), &data, write.len);
+    chan_out_send(ch, msg, SIMBRICKS_PROTO_MEM_H2M_MSG_WRITE_POSTED);
+    stats.h2m_writes++;
+    cache_write(icache, addr, word, be);
+    cache_write(dcache, addr, word, be);
+    return RV32_MEM_OK;
+}
+
+static const rv32_bus ff_bus = {ff_fetch, ff_load, ff_store};
+
+static inline void ff_advance(uint64_t cycles, uint64_t clock_period)
+{
+    cur_cycle += cycles;
+    main_time += cycles * clock_period;
+    if (not (ff.iss.mcountinhibit & 1))
+        ff.iss.mcycle += cycles;
+    ff.cycles += cycles;
+}
+
+// hands the simulator state to the model
+static void ff_to_rtl(Vibex_top &dut)
+{
+    for (unsigned r = 1; r < 32; r++)
+        ff_word(FF_REGS + r) = ff.iss.x[r];
+    ff_word(FF_PC) = ff.iss.pc;
+    for (unsigned i = 0; i < FF_NUM_CSRS; i++)
+        rv32_csr_read(ff.iss, ff_csrs[i], ff_word(FF_CSRS + i));
+    ff_word(FF_STATUS) = 0;
+    ff_word(FF_CMD) = 1;
+    // a parked model picks the command up by itself
+    if (not ff.parked)
+        dut.debug_req_i = 1;
+    ff.mode = FF_TO_RTL;
+    ff.next_check = cur_cycle;
+    ff.handoffs++;
+}
+
+// takes the state the model stored
+static void ff_from_rtl()
+{
+    for (unsigned r = 1; r < 32; r++)
+        ff.iss.x[r] = ff_word(FF_REGS + r);
+    ff.iss.pc = ff_word(FF_PC);
+    for (unsigned i = 0; i < FF_NUM_CSRS; i++)
+        rv32_csr_write(ff.iss, ff_csrs[i], ff_word(FF_CSRS + i));
+    // the debug request woke the model, so it continues after a WFI
+    ff.sleeping = false;
+}
+
+static bool ff_period_over()
+{
+    if (ff.insns >= ff.iss_end or main_time >= ff_cfg.until_time)
+        return true;
+    return ff.until_pc and ff.iss.pc == ff_cfg.until_pc;
+}
+
+// cycles until a channel or the main loop needs attention
+static uint64_t ff_burst(uint64_t clock_period, uint64_t end_cycle)
+{
+    uint64_t burst = FF_MAX_BURST;
+    for (unsigned c = 0; c < num_chans; c++)
+    {
+        if (not chans[c].sync)
+        {
+            // no timestamps to wait for, poll every cycle while a read is out
+            if (ff.read_pending)
+                burst = 1;
+            continue;
+        }
+        uint64_t target = std::min(chans[c].next_poll, chans[c].next_sync);
+        burst = std::min(burst, target > main_time ? (target - main_time) / clock_period : 0);
+    }
+    return std::max<uint64_t>(std::min(burst, end_cycle - cur_cycle), 1);
+}
+
+// one iteration of the main loop while the simulator runs, stops at end_cycle
+// at the latest
+static void ff_run(Vibex_top &dut, uint64_t clock_period, uint64_t end_cycle)
+{
+    for (unsigned c = 0; c < num_chans; c++)
+    {
+        if (chans[c].sync and main_time >= chans[c].next_sync)
+            chan_sync(chans[c]);
+    }
+    txn_send_unsent(main_time);
+    for (unsigned c = 0; c < num_chans; c++)
+    {
+        if (main_time >= chans[c].next_poll)
+            chan_drain(chans[c]);
+    }
+
+    uint64_t burst = ff_burst(clock_period, end_cycle);
+    for (uint64_t n = 0; n < burst and not exiting and not halted; n++)
+    {
+        ff.iss.mip = timer_irq() ? RV32_IRQ_TIMER : 0;
+        if (ff.sleeping and (ff.iss.mip & ff.iss.mie) == 0)
+        {
+            // only the timer can wake the core before the next message
+            uint64_t skip = std::min({burst - n, ff_burst(clock_period, end_cycle),
+                                      std::max<uint64_t>(1, timer_next_irq_cycle() - cur_cycle)});
+            ff_advance(skip, clock_period);
+            break;
+        }
+        ff.sleeping = false;
+        rv32_step_result res = rv32_step(ff.iss, ff_bus);
+        if (res == RV32_RETRY)
+        {
+            // nothing changes before the next message, a read issued by this
+            // step shortens the burst on unsynchronized channels
+            ff_advance(std::min(burst - n, ff_burst(clock_period, end_cycle)), clock_period);
+            break;
+        }
+        ff_reads_retire();
+        if (res != RV32_TRAPPED)
+            ff.insns++;
+        ff.sleeping = res == RV32_WFI;
+        ff_advance(1, clock_period);
+        // the model would not sleep after the handoff, so it waits for the wakeup
+        if (not ff.sleeping and ff_period_over())
+        {
+            ff.until_pc = false;
+            ff_to_rtl(dut);
+            break;
+        }
+    }
+}
+
+// steps of a handoff and the end of a sampling window, while the model runs
+static void ff_poll(Vibex_top &dut)
+{
+    if (ff.mode != FF_RTL and dut.instr_req_o and dut.instr_addr_o == ff_cfg.dm_addr + 8)
+    {
+        fprintf(stderr, "ff: exception in the debug mode state transfer\n");
+        exiting = true;
+        return;
+    }
+    switch (ff.mode)
+    {
+    case FF_TO_RTL:
+        if (ff_word(FF_STATUS) != FF_STATUS_RESTORING)
+            return;
+        // drop the request before dret, the model would enter debug mode again
+        dut.debug_req_i = 0;
+        ff.parked = false;
+        ff.rtl_start = cur_cycle;
+        if (ff_cfg.window == 0)
+        {
+            ff.mode = FF_OFF;
+            ff.next_check = UINT64_MAX;
+            return;
+        }
+        ff.mode = FF_RTL;
+        ff.next_check = cur_cycle + ff_cfg.window;
+        return;
+    case FF_RTL:
+        ff.rtl_cycles += cur_cycle - ff.rtl_start;
+        ff_word(FF_STATUS) = 0;
+        ff_word(FF_CMD) = 0;
+        dut.debug_req_i = 1;
+        ff.mode = FF_TO_ISS;
+        ff.next_check = cur_cycle;
+        return;
+    case FF_TO_ISS:
+        if (ff_word(FF_STATUS) != FF_STATUS_SAVED)
+            return;
+        dut.debug_req_i = 0;
+        ff.parked = true;
+        ff_from_rtl();
+        ff.iss_end = ff.insns + ff_cfg.period;
+        ff.mode = FF_ISS;
+        ff.next_check = UINT64_MAX;
+        ff.handoffs++;
+        return;
+    default:
+        return;
+    }
+}
+
+static void ff_print_stats()
+{
+    if (ff.mode == FF_RTL)
+        ff.rtl_cycles += cur_cycle - ff.rtl_start;
+    fprintf(stderr, "ff: insns=%lu cycles=%lu handoffs=%lu window_cycles=%lu\n", ff.insns, ff.cycles, ff.handoffs,
+            ff.rtl_cycles);
+}
+
+/* **************************************************************************
+ * waveform tracing
+ *
+ * Tracing is compiled in by default but only starts at runtime, either when
+ * the configured window and trigger are reached or on SIGUSR2, which toggles
+ * it. Cycles in which tracing is not active cost a single branch.
+ * ************************************************************************** */
+
+#if VM_TRACE
+#if VM_TRACE_FST
+typedef VerilatedFstC trace_file;
+#define TRACE_DEFAULT_PATH "ibex-verilator-debug.fst"
+#else
+typedef VerilatedVcdC trace_file;
+#define TRACE_DEFAULT_PATH "ibex-verilator-debug.vcd"
+#endif
+#endif
+
+struct trace_state {
+    const char *path = nullptr; // set when tracing is configured
+    int level = 40;
+    uint64_t start = 0; // simulated time window in ps
+    uint64_t stop = UINT64_MAX;
+    bool pc_trigger = false; // start on a fetch from this address
+    uint32_t pc = 0;
+    bool addr_trigger = false; // start on a data access to this word
+    uint32_t addr = 0;
+
+    bool check = false;  // window or trigger still pending
+    bool active = false; // dumping
+#if VM_TRACE
+    std::unique_ptr<trace_file> file;
+#endif
+};
+
+static thread_local trace_state trace; // only used by the first core
+
+#if VM_TRACE
+static void trace_set_active(bool active)
+{
+    if (active and not trace.file->isOpen())
+    {
+        trace.file->open(trace.path ? trace.path : TRACE_DEFAULT_PATH);
+    }
+    if (active != trace.active)
+    {
+        sim_log::LogInfo("trace: %s at %lu\n", active ? "started" : "stopped", main_time);
+    }
+    trace.active = active;
+}
+
+static void trace_update(Vibex_top &dut)
+{
+    if (trace_toggle)
+    {
+        trace_toggle = 0;
+        trace_set_active(not trace.active);
+        return;
+    }
+    if (not trace.check)
+        return;
+
+    if (main_time >= trace.stop)
+    {
+        trace_set_active(false);
+        trace.check = false;
+        return;
+    }
+    if (trace.active or main_time < trace.start)
+        return;
+    if (trace.pc_trigger and not (dut.instr_req_o and dut.instr_gnt_i and dut.instr_addr_o == trace.pc))
+        return;
+    if (trace.addr_trigger and not (dut.data_req_o and dut.data_gnt_i and dut.data_addr_o == (trace.addr & ~3U)))
+        return;
+    // the trigger fired, only the end of the window is left to check
+    trace.pc_trigger = false;
+    trace.addr_trigger = false;
+    trace_set_active(true);
+}
+#endif
+
+/* **************************************************************************
+ * retirement trace
+ *
+ * Models built with +define+RVFI (the rvfi variant) expose the RISC-V Formal
+ * Interface of ibex_top. With --rvfi-trace every retired instruction is
+ * appended to a compact binary trace: PC, instruction, register writeback,
+ * data address and cycle. The main loop encodes the records into blocks of a
+ * lock-free ring, a writer thread per core moves full blocks to the file.
+ * When the writer falls behind, records are dropped and counted instead of
+ * stalling the simulation.
+ *
+ * File format (little endian): the header is the magic "IBEXRVFI", a u32
+ * version and the u32 hart ID. Then follow blocks, each with a u32 payload
+ * length, a u32 record count, the u64 cycle the deltas start from and the u64
+ * number of records dropped before the block. The delta state is reset at
+ * every block. A record is a flags byte, then
+ *   RVFI_F_PC   zigzag LEB128 of pc - expected pc, the expected pc is the
+ *               address after the previous instruction and 0 at the start of a
+ *               block, so only jumps, taken branches and traps store it
+ *   RVFI_F_RD   u8 rd, LEB128 of the value written
+ *   RVFI_F_MEM  zigzag LEB128 of addr - previous data address, u8 rmask |
+ *               wmask << 4
+ *   always      LEB128 of the cycles since the previous record, then the
+ *               instruction, 2 bytes if compressed, otherwise 4
+ * rvfi_decode.py reads the format.
+ * ************************************************************************** */
+
+#define RVFI_MAGIC 0x4946565258454249ULL // "IBEXRVFI"
+#define RVFI_VERSION 1
+#define RVFI_BLOCK_DATA (64 * 1024)
+#define RVFI_RING_BLOCKS 64
+#define RVFI_MAX_RECORD 32
+
+enum {
+    RVFI_F_PC = 1 << 0,
+    RVFI_F_RD = 1 << 1,
+    RVFI_F_MEM = 1 << 2,
+    RVFI_F_TRAP = 1 << 3, // rvfi_trap, the instruction raised an exception
+    RVFI_F_INTR = 1 << 4, // rvfi_intr, first instruction of a trap handler
+};
+
+struct rvfi_block {
+    uint32_t len;
+    uint32_t records;
+    uint64_t cycle;
+    uint64_t dropped;
+    uint8_t data[RVFI_BLOCK_DATA];
+};
+
+static const char *rvfi_path = nullptr; // --rvfi-trace
+
+struct rvfi_state {
+    bool active = false;
+    FILE *file = nullptr;
+    std::unique_ptr<rvfi_block[]> ring;
+    // blocks handed to the writer and blocks it has written, only the main
+    // loop stores head and only the writer stores tail
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<bool> closing{false};
+    std::thread writer;
+
+    rvfi_block *cur = nullptr; // being filled, nullptr while the ring is full
+    uint64_t dropped = 0;      // since the last block
+    uint32_t next_pc = 0;
+    uint32_t mem_addr = 0;
+    uint64_t cycle = 0;
+
+    uint64_t records = 0;
+    uint64_t drops = 0;
+    uint64_t bytes = 0;
+};
+
+static thread_local rvfi_state rvfi;
+
+static void rvfi_writer(rvfi_state *r)
+{
+    for (;;)
+    {
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        if (tail == r->head.load(std::memory_order_acquire))
+        {
+            if (r->closing.load(std::memory_order_acquire) and tail == r->head.load(std::memory_order_acquire))
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        const rvfi_block &b = r->ring[tail % RVFI_RING_BLOCKS];
+        if (fwrite(&b, offsetof(rvfi_block, data) + b.len, 1, r->file) != 1)
+            perror("rvfi: writing the trace failed");
+        r->tail.store(tail + 1, std::memory_order_release);
+    }
+}
+
+static bool rvfi_open()
+{
+    if (rvfi_path == nullptr)
+        return true;
+    rvfi.file = fopen(core_file_path(rvfi_path).c_str(), "wb");
+    if (rvfi.file == nullptr)
+    {
+        perror("opening rvfi trace failed");
+        return false;
+    }
+    uint64_t magic = RVFI_MAGIC;
+    uint32_t version = RVFI_VERSION, hart_id = core_id;
+    fwrite(&magic, sizeof(magic), 1, rvfi.file);
+    fwrite(&version, sizeof(version), 1, rvfi.file);
+    fwrite(&hart_id, sizeof(hart_id), 1, rvfi.file);
+    rvfi.ring = std::make_unique<rvfi_block[]>(RVFI_RING_BLOCKS);
+    rvfi.writer = std::thread(rvfi_writer, &rvfi);
+    rvfi.active = true;
+    return true;
+}
+
+static void rvfi_block_publish()
+{
+    rvfi.bytes += offsetof(rvfi_block, data) + rvfi.cur->len;
+    rvfi.head.store(rvfi.head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    rvfi.cur = nullptr;
+}
+
+#if IBEX_RVFI
+static bool rvfi_block_begin()
+{
+    uint64_t head = rvfi.head.load(std::memory_order_relaxed);
+    if (head - rvfi.tail.load(std::memory_order_acquire) == RVFI_RING_BLOCKS)
+        return false;
+    rvfi.cur = &rvfi.ring[head % RVFI_RING_BLOCKS];
+    rvfi.cur->len = 0;
+    rvfi.cur->records = 0;
+    rvfi.cur->cycle = cur_cycle;
+    rvfi.cur->dropped = rvfi.dropped;
+    rvfi.dropped = 0;
+    rvfi.next_pc = 0;
+    rvfi.mem_addr = 0;
+    rvfi.cycle = cur_cycle;
+    return true;
+}
+
+static inline uint8_t *rvfi_put_uleb(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = uint8_t(v) | 0x80;
+        v >>= 7;
+    }
+    *p++ = uint8_t(v);
+    return p;
+}
+
+static inline uint8_t *rvfi_put_sleb(uint8_t *p, int32_t v)
+{
+    return rvfi_put_uleb(p, (uint32_t(v) << 1) ^ uint32_t(v >> 31));
+}
+
+// called after the rising edge, when rvfi_valid is set
+static void rvfi_record(const Vibex_top &dut)
+{
+    if (rvfi.cur != nullptr and rvfi.cur->len + RVFI_MAX_RECORD > RVFI_BLOCK_DATA)
+        rvfi_block_publish();
+    if (rvfi.cur == nullptr and not rvfi_block_begin())
+    {
+        rvfi.dropped++;
+        rvfi.drops++;
+        return;
+    }
+
+    uint8_t *start = rvfi.cur->data + rvfi.cur->len;
+    uint8_t *p = start + 1;
+    uint8_t flags = 0;
+    if (dut.rvfi_pc_rdata != rvfi.next_pc)
+    {
+        flags |= RVFI_F_PC;
+        p = rvfi_put_sleb(p, int32_t(dut.rvfi_pc_rdata - rvfi.next_pc));
+    }
+    if (dut.rvfi_rd_addr != 0)
+    {
+        flags |= RVFI_F_RD;
+        *p++ = dut.rvfi_rd_addr;
+        p = rvfi_put_uleb(p, dut.rvfi_rd_wdata);
+    }
+    if (dut.rvfi_mem_rmask or dut.rvfi_mem_wmask)
+    {
+        flags |= RVFI_F_MEM;
+        p = rvfi_put_sleb(p, int32_t(dut.rvfi_mem_addr - rvfi.mem_addr));
+        *p++ = (dut.rvfi_mem_rmask & 0xf) | (dut.rvfi_mem_wmask & 0xf) << 4;
+        rvfi.mem_addr = dut.rvfi_mem_addr;
+    }
+    if (dut.rvfi_trap)
+        flags |= RVFI_F_TRAP;
+    if (dut.rvfi_intr)
+        flags |= RVFI_F_INTR;
+    *start = flags;
+    p = rvfi_put_uleb(p, cur_cycle - rvfi.cycle);
+    uint32_t insn = dut.rvfi_insn;
+    unsigned insn_len = (insn & 3) == 3 ? 4 : 2;
+    memcpy(p, &insn, insn_len);
+    p += insn_len;
+
+    rvfi.cur->len += p - start;
+    rvfi.cur->records++;
+    rvfi.next_pc = dut.rvfi_pc_rdata + insn_len;
+    rvfi.cycle = cur_cycle;
+    rvfi.records++;
+}
+#endif
+
+static void rvfi_close()
+{
+    if (not rvfi.active)
+        return;
+    if (rvfi.cur != nullptr)
+        rvfi_block_publish();
+    rvfi.closing.store(true, std::memory_order_release);
+    rvfi.writer.join();
+    fclose(rvfi.file);
+    rvfi.active = false;
+}
+
+static void rvfi_print_stats()
+{
+    fprintf(stderr, "rvfi: records=%lu dropped=%lu bytes=%lu\n", rvfi.records, rvfi.drops, rvfi.bytes);
+}
+
+/* **************************************************************************
+ * guest profiler
+ *
+ * Samples the PC of the core every profile interval cycles, together with
+ * whether the core is running, waiting for a fetch or a load/store, or
+ * sleeping, and writes a histogram symbolized against the application ELF at
+ * exit. Without RVFI the sampled PC is that of the current instruction fetch,
+ * which runs a few instructions ahead, and a sample has a single frame. In
+ * the rvfi variant it is the PC of the last retired instruction, and the
+ * calls and returns seen on RVFI maintain a shadow call stack, so folded
+ * output contains the callers as well.
+ * ************************************************************************** */
+
+#define PROF_MAX_DEPTH 32U
+
+enum prof_sample_state {
+    PROF_RUN,
+    PROF_FETCH_STALL,
+    PROF_DATA_STALL,
+    PROF_SLEEP,
+    PROF_FUNCTIONAL, // in the functional fast-forward
+    PROF_NUM_STATES,
+};
+
+static const char *prof_state_names[PROF_NUM_STATES] = {"run", "fetch_stall", "data_stall", "sleep",
+                                                        "functional"};
+
+struct prof_config {
+    const char *path = nullptr; // --profile
+    const char *elf = nullptr;  // --profile-elf, defaults to --local-elf
+    uint64_t interval = 1000;   // cycles
+    bool folded = false;        // --profile-format=folded
+};
+
+static prof_config prof_cfg;
+
+struct prof_state {
+    bool active = false;
+    uint64_t next_sample = UINT64_MAX;
+    uint32_t pc = 0; // last retired instruction, with RVFI
+    // call sites on the shadow call stack, depth keeps counting past
+    // PROF_MAX_DEPTH
+    uint32_t stack[PROF_MAX_DEPTH];
+    unsigned depth = 0;
+    // key: stack entries, PC, state
+    std::map<std::vector<uint32_t>, uint64_t> samples;
+    uint64_t num_samples = 0;
+};
+
+static thread_local prof_state prof;
+
+static void prof_start()
+{
+    if (prof_cfg.path == nullptr)
+        return;
+    prof.active = true;
+    prof.next_sample = cur_cycle + prof_cfg.interval;
+}
+
+#if IBEX_RVFI
+static inline void prof_push(uint32_t call_pc)
+{
+    if (prof.depth < PROF_MAX_DEPTH)
+        prof.stack[prof.depth] = call_pc;
+    prof.depth++;
+}
+
+static inline void prof_pop()
+{
+    if (prof.depth > 0)
+        prof.depth--;
+}
+
+static inline bool prof_link_reg(uint32_t reg)
+{
+    return reg == 1 or reg == 5;
+}
+
+// follows calls and returns, after the rising edge when rvfi_valid is set
+static void prof_retire(const Vibex_top &dut)
+{
+    // the handler was entered from the previously retired instruction
+    if (dut.rvfi_intr)
+        prof_push(prof.pc);
+    prof.pc = dut.rvfi_pc_rdata;
+    uint32_t insn = dut.rvfi_insn;
+    if ((insn & 3) == 3)
+    {
+        uint32_t op = insn & 0x7f, rd = insn >> 7 & 31, rs1 = insn >> 15 & 31;
+        if ((op == 0x6f or op == 0x67) and prof_link_reg(rd))
+            prof_push(dut.rvfi_pc_rdata);
+        else if (op == 0x67 and rd == 0 and prof_link_reg(rs1))
+            prof_pop();
+        else if (insn == 0x30200073) // mret
+            prof_pop();
+        return;
+    }
+    uint32_t rs1 = insn >> 7 & 31;
+    if ((insn & 0xe003) == 0x2001) // c.jal
+        prof_push(dut.rvfi_pc_rdata);
+    else if ((insn & 0xf07f) == 0x9002 and rs1 != 0) // c.jalr
+        prof_push(dut.rvfi_pc_rdata);
+    else if ((insn & 0xf07f) == 0x8002 and prof_link_reg(rs1)) // c.jr ra
+        prof_pop();
+}
+#endif
+
+static void prof_sample(const Vibex_top &dut)
+{
+    // WFI and fast-forward skips count for every interval they covered
+    uint64_t weight = (cur_cycle - prof.next_sample) / prof_cfg.interval + 1;
+    prof.next_sample += weight * prof_cfg.interval;
+
+    uint32_t pc = dut.instr_addr_o;
+    prof_sample_state state = PROF_RUN;
+#if IBEX_RVFI
+    pc = prof.pc;
+#endif
+    if (ff.mode == FF_ISS)
+    {
+        pc = ff.iss.pc;
+        state = PROF_FUNCTIONAL;
+    }
+    else if (dut.core_sleep_o)
+        state = PROF_SLEEP;
+    else if (txn_stalled & (1 << PORT_DATA))
+        state = PROF_DATA_STALL;
+    else if (txn_stalled & (1 << PORT_INSTR))
+        state = PROF_FETCH_STALL;
+
+    std::vector<uint32_t> key(prof.stack, prof.stack + std::min(prof.depth, PROF_MAX_DEPTH));
+    key.push_back(pc);
+    key.push_back(state);
+    prof.samples[key] += weight;
+    prof.num_samples += weight;
+}
+
+static std::string prof_symbol(const std::vector<elf_symbol> &syms, uint32_t addr)
+{
+    auto it = std::upper_bound(syms.begin(), syms.end(), addr,
+                               [](uint32_t a, const elf_symbol &s) { return a < s.addr; });
+    if (it != syms.begin())
+    {
+        const elf_symbol &s = *(it - 1);
+        if (s.size == 0 or addr < s.addr + s.size)
+            return s.name;
+    }
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%08x", addr);
+    return buf;
+}
+
+static void prof_write()
+{
+    std::vector<elf_symbol> syms;
+    elf_image img;
+    const char *elf = prof_cfg.elf ? prof_cfg.elf : local_elf;
+    if (elf != nullptr and not (elf_read(elf, img) and elf_read_symbols(img, syms)))
+        fprintf(stderr, "profile: no symbols from %s\n", elf);
+
+    FILE *f = fopen(core_file_path(prof_cfg.path).c_str(), "w");
+    if (f == nullptr)
+    {
+        perror("opening profile failed");
+        return;
+    }
+
+    // folded: one line per distinct stack, the state as the innermost frame
+    std::map<std::string, uint64_t> folded;
+    // flat: samples per function and state
+    std::map<std::string, std::array<uint64_t, PROF_NUM_STATES>> flat;
+    uint64_t stalled = 0;
+    for (const auto &[key, count] : prof.samples)
+    {
+        unsigned state = key.back();
+        std::string leaf = prof_symbol(syms, key[key.size() - 2]);
+        if (state == PROF_FETCH_STALL or state == PROF_DATA_STALL)
+            stalled += count;
+        flat[leaf][state] += count;
+        if (not prof_cfg.folded)
+            continue;
+        std::string line;
+        for (size_t i = 0; i + 2 < key.size(); i++)
+            line += prof_symbol(syms, key[i]) + ";";
+        line += leaf + ";";
+        if (state == PROF_RUN)
+            line.pop_back();
+        else
+            line += std::string("[") + prof_state_names[state] + "]";
+        folded[line] += count;
+    }
+
+    if (prof_cfg.folded)
+    {
+        for (const auto &[line, count] : folded)
+            fprintf(f, "%s %lu\n", line.c_str(), count);
+    }
+    else
+    {
+        std::vector<std::pair<uint64_t, const std::string *>> order;
+        for (const auto &[name, counts] : flat)
+        {
+            uint64_t total = 0;
+            for (uint64_t c : counts)
+                total += c;
+            order.push_back({total, &name});
+        }
+        std::sort(order.begin(), order.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+        fprintf(f, "# samples=%lu interval=%lu cycles\n# %8s %7s", prof.num_samples, prof_cfg.interval,
+                "samples", "percent");
+        for (const char *name : prof_state_names)
+            fprintf(f, " %11s", name);
+        fprintf(f, "  function\n");
+        for (const auto &[total, name] : order)
+        {
+            fprintf(f, "%10lu %6.2f%%", total, 100.0 * total / prof.num_samples);
+            for (uint64_t c : flat[*name])
+                fprintf(f, " %11lu", c);
+            fprintf(f, "  %s\n", name->c_str());
+        }
+    }
+    fclose(f);
+    fprintf(stderr, "profile: samples=%lu stalled=%lu functions=%zu symbols=%zu\n", prof.num_samples, stalled,
+            flat.size(), syms.size());
+}
+
+/* **************************************************************************
+ * memory access statistics
+ *
+ * Classifies the requests of the core by region: the text, rodata and data
+ * sections of the ELF file, the stack, the simulation control block and the
+ * timer. Fetches, reads and writes are counted per region and per page, and
+ * for the memory regions the instruction and data streams each get a
+ * histogram of LRU stack distances in cache lines. An access with distance d
+ * hits in a fully associative LRU cache of more than d lines, so the
+ * histograms give the hit rate for every cache size at once. All counters
+ * are flat arrays over the address span of the regions, allocated at
+ * startup. Accesses outside the span only count towards "other".
+ * ************************************************************************** */
+
+#define MS_MAX_SPAN (64U << 20)
+#define MS_SIM_CTRL_SIZE 0x10
+#define MS_DIST_BUCKETS 33 // 0, then powers of two
+
+struct ms_config {
+    const char *path = nullptr; // --mem-stats
+    const char *elf = nullptr;  // --mem-stats-elf, defaults to --local-elf
+    uint32_t line_size = 32;
+    uint32_t page_size = 4096;
+    // the stack of app/common/link.ld
+    uint32_t stack_base = 0x130000;
+    uint32_t stack_size = 0x8000;
+};
+
+static ms_config ms_cfg;
+
+struct ms_region {
+    const char *name;
+    uint32_t base;
+    uint32_t size;
+    bool memory; // part of the stack distances
+    uint64_t fetches = 0;
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+};
+
+enum ms_page_counter {
+    MS_FETCHES,
+    MS_READS,
+    MS_WRITES,
+    MS_NUM_COUNTERS,
+};
+
+/* Stack distances from a Fenwick tree over access times: every line marks
+ * the time of its last access, so the distance of an access is the number of
+ * marks after the previous access to the same line. When the times run out
+ * they are renumbered in order. */
+struct ms_reuse {
+    std::vector<uint32_t> last; // per line, time of the last access, 0 for never
+    std::vector<uint32_t> tree; // index 0 unused
+    uint32_t now = 0;
+    uint32_t marks = 0;
+    uint64_t cold = 0;
+    uint64_t hist[MS_DIST_BUCKETS] = {};
+};
+
+struct ms_state {
+    bool active = false;
+    uint32_t base = 0; // of the span
+    unsigned line_shift = 0;
+    unsigned page_shift = 0;
+    std::vector<ms_region> regions; // the last one is "other"
+    std::vector<uint8_t> line_region;
+    std::vector<std::array<uint64_t, MS_NUM_COUNTERS>> pages;
+    ms_reuse reuse[NUM_PORTS];
+};
+
+static thread_local ms_state ms;
+
+// BASE:SIZE of --mem-stats-stack
+static bool ms_parse_stack(const char *spec)
+{
+    char *end;
+    ms_cfg.stack_base = strtoul(spec, &end, 0);
+    ms_cfg.stack_size = *end == ':' ? strtoul(end + 1, &end, 0) : 0;
+    if (*end != 0 or ms_cfg.stack_size == 0)
+    {
+        fprintf(stderr, "mem-stats: expected BASE:SIZE for the stack, got %s\n", spec);
+        return false;
+    }
+    return true;
+}
+
+static void ms_tree_add(ms_reuse &r, uint32_t t, int32_t delta)
+{
+    for (; t < r.tree.size(); t += t & -t)
+        r.tree[t] += delta;
+}
+
+static uint32_t ms_tree_sum(const ms_reuse &r, uint32_t t)
+{
+    uint32_t sum = 0;
+    for (; t > 0; t -= t & -t)
+        sum += r.tree[t];
+    return sum;
+}
+
+static void ms_reuse_renumber(ms_reuse &r)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> order; // time, line
+    for (uint32_t line = 0; line < r.last.size(); line++)
+    {
+        if (r.last[line] != 0)
+            order.push_back({r.last[line], line});
+    }
+    std::sort(order.begin(), order.end());
+    std::fill(r.tree.begin(), r.tree.end(), 0);
+    r.now = 0;
+    for (const auto &[time, line] : order)
+    {
+        r.last[line] = ++r.now;
+        ms_tree_add(r, r.now, 1);
+    }
+}
+
+static void ms_reuse_access(ms_reuse &r, uint32_t line)
+{
+    if (r.now + 1 == r.tree.size())
+        ms_reuse_renumber(r);
+    uint32_t prev = r.last[line];
+    if (prev == 0)
+    {
+        r.cold++;
+        r.marks++;
+    }
+    else
+    {
+        uint32_t dist = r.marks - ms_tree_sum(r, prev);
+        r.hist[dist == 0 ? 0 : 32 - __builtin_clz(dist)]++;
+        ms_tree_add(r, prev, -1);
+    }
+    r.last[line] = ++r.now;
+    ms_tree_add(r, r.now, 1);
+}
+
+static bool ms_setup()
+{
+    if (ms_cfg.path == nullptr)
+        return true;
+
+    std::vector<elf_section> secs;
+    elf_image img;
+    const char *elf = ms_cfg.elf ? ms_cfg.elf : local_elf;
+    if (elf != nullptr and not (elf_read(elf, img) and elf_read_sections(img, secs)))
+        return false;
+    bool have_sections = not secs.empty();
+    if (not have_sections)
+    {
+        // the RAM of app/common/link.ld, reported as "ram" in place of "text"
+        fprintf(stderr, "mem-stats: no ELF sections, counting the RAM as one region\n");
+        secs.push_back({0x100000, 0x30000, true, false});
+    }
+
+    ms.regions.clear();
+    ms.regions.push_back({"text", 0, 0, true});
+    ms.regions.push_back({"rodata", 0, 0, true});
+    ms.regions.push_back({"data", 0, 0, true});
+    ms.regions.push_back({"stack", ms_cfg.stack_base, ms_cfg.stack_size, true});
+    ms.regions.push_back({"sim_ctrl", sim_ctrl.base, MS_SIM_CTRL_SIZE, false});
+    if (timer.enabled)
+        ms.regions.push_back({"timer", timer.base, TIMER_SIZE, false});
+    ms.regions.push_back({"other", 0, 0, true});
+    if (not have_sections)
+        ms.regions[0].name = "ram";
+
+    // the sections cover the smallest range holding all of them per kind
+    std::vector<unsigned> sec_region;
+    for (const elf_section &s : secs)
+    {
+        unsigned i = s.exec ? 0 : s.write ? 2 : 1;
+        ms_region &r = ms.regions[i];
+        uint64_t end = std::max(uint64_t(r.base) + r.size, uint64_t(s.addr) + s.size);
+        r.base = r.size ? std::min(r.base, s.addr) : s.addr;
+        r.size = end - r.base;
+        sec_region.push_back(i);
+    }
+
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (const ms_region &r : ms.regions)
+    {
+        if (r.size == 0)
+            continue;
+        lo = std::min<uint64_t>(lo, r.base);
+        hi = std::max<uint64_t>(hi, uint64_t(r.base) + r.size);
+    }
+    lo &= ~uint64_t(ms_cfg.page_size - 1);
+    hi = (hi + ms_cfg.page_size - 1) & ~uint64_t(ms_cfg.page_size - 1);
+    if (hi - lo > MS_MAX_SPAN)
+    {
+        fprintf(stderr, "mem-stats: regions span %lx-%lx, more than %u MiB\n", lo, hi, MS_MAX_SPAN >> 20);
+        return false;
+    }
+
+    ms.base = lo;
+    ms.line_shift = __builtin_ctz(ms_cfg.line_size);
+    ms.page_shift = __builtin_ctz(ms_cfg.page_size);
+    uint32_t lines = (hi - lo) >> ms.line_shift;
+    ms.line_region.assign(lines, ms.regions.size() - 1);
+    ms.pages.assign((hi - lo) >> ms.page_shift, {});
+    auto mark = [&](uint32_t base, uint32_t size, unsigned region) {
+        uint32_t first = (base - ms.base) >> ms.line_shift;
+        uint32_t end = (uint64_t(base) - ms.base + size + ms_cfg.line_size - 1) >> ms.line_shift;
+        std::fill(ms.line_region.begin() + first, ms.line_region.begin() + end, region);
+    };
+    // sections one by one, so the gaps between them stay "other"
+    for (size_t i = 0; i < secs.size(); i++)
+        mark(secs[i].addr, secs[i].size, sec_region[i]);
+    for (unsigned i = 3; i + 1 < ms.regions.size(); i++)
+        mark(ms.regions[i].base, ms.regions[i].size, i);
+
+    for (ms_reuse &r : ms.reuse)
+    {
+        r.last.assign(lines, 0);
+        // times for at least as many accesses as there are lines between renumberings
+        r.tree.assign(std::max(2 * lines, 1U << 16), 0);
+    }
+    ms.active = true;
+    return true;
+}
+
+static void ms_access(mem_port port, uint32_t addr, bool we, uint8_t be)
+{
+    uint32_t offset = addr - ms.base;
+    uint32_t line = offset >> ms.line_shift;
+    ms_region *r = &ms.regions.back();
+    if (line < ms.line_region.size())
+    {
+        r = &ms.regions[ms.line_region[line]];
+        ms.pages[offset >> ms.page_shift][port == PORT_INSTR ? MS_FETCHES : we ? MS_WRITES : MS_READS]++;
+        if (r->memory)
+            ms_reuse_access(ms.reuse[port], line);
+    }
+    if (port == PORT_INSTR)
+    {
+        r->fetches++;
+    }
+    else if (we)
+    {
+        r->writes++;
+        r->write_bytes += __builtin_popcount(be);
+    }
+    else
+    {
+        r->reads++;
+        r->read_bytes += __builtin_popcount(be);
+    }
+}
+
+// the requests the core hands over on the coming rising edge
+static inline void ms_observe(const Vibex_top &dut)
+{
+    if (dut.instr_req_o and dut.instr_gnt_i)
+        ms_access(PORT_INSTR, dut.instr_addr_o, false, 0xf);
+    if (dut.data_req_o and dut.data_gnt_i)
+        ms_access(PORT_DATA, dut.data_addr_o, dut.data_we_o, dut.data_be_o);
+}
+
+static void ms_write()
+{
+    for (const ms_region &r : ms.regions)
+    {
+        uint64_t data = r.reads + r.writes;
+        fprintf(stderr, "mem-stats: region=%s fetches=%lu reads=%lu writes=%lu write_pct=%.1f\n", r.name, r.fetches,
+                r.reads, r.writes, data ? 100.0 * r.writes / data : 0.0);
+    }
+
+    FILE *f = fopen(core_file_path(ms_cfg.path).c_str(), "w");
+    if (f == nullptr)
+    {
+        perror("opening mem-stats file failed");
+        return;
+    }
+    fprintf(f, "{\"line_size\": %u, \"page_size\": %u,\n \"regions\": [", ms_cfg.line_size, ms_cfg.page_size);
+    for (size_t i = 0; i < ms.regions.size(); i++)
+    {
+        const ms_region &r = ms.regions[i];
+        fprintf(f,
+                "%s\n  {\"name\": \"%s\", \"base\": %u, \"size\": %u, \"fetches\": %lu, \"reads\": %lu, "
+                "\"writes\": %lu, \"read_bytes\": %lu, \"write_bytes\": %lu}",
+                i ? "," : "", r.name, r.base, r.size, r.fetches, r.reads, r.writes, r.read_bytes, r.write_bytes);
+    }
+    // untouched pages are left out
+    fprintf(f, "],\n \"pages\": [");
+    bool first = true;
+    for (size_t i = 0; i < ms.pages.size(); i++)
+    {
+        const auto &p = ms.pages[i];
+        if (p[MS_FETCHES] + p[MS_READS] + p[MS_WRITES] == 0)
+            continue;
+        fprintf(f, "%s\n  {\"addr\": %lu, \"fetches\": %lu, \"reads\": %lu, \"writes\": %lu}", first ? "" : ",",
+                ms.base + (uint64_t(i) << ms.page_shift), p[MS_FETCHES], p[MS_READS], p[MS_WRITES]);
+        first = false;
+    }
+    // hist[0] counts distance 0, hist[i] distances from 2^(i-1) to 2^i - 1
+    fprintf(f, "],\n \"stack_distance\": {");
+    for (int p = 0; p < NUM_PORTS; p++)
+    {
+        const ms_reuse &r = ms.reuse[p];
+        int last = MS_DIST_BUCKETS - 1;
+        while (last > 0 and r.hist[last] == 0)
+            last--;
+        fprintf(f, "%s\n  \"%s\": {\"cold\": %lu, \"hist\": [", p ? "," : "", port_names[p], r.cold);
+        for (int i = 0; i <= last; i++)
+            fprintf(f, "%s%lu", i ? ", " : "", r.hist[i]);
+        fprintf(f, "]}");
+    }
+    fprintf(f, "}}\n");
+    fclose(f);
+}
+
+/* **************************************************************************
+ * guest performance counters
+ *
+ * The CSR counters of the core (mcycle, minstret and the mhpmcounters) are
+ * read from the model through the DPI functions ibex_cs_registers exports for
+ * Verilator, and reported when the simulation ends. Counter n is at index n,
+ * index 1 (time) is not implemented by Ibex.
+ * ************************************************************************** */
+
+#define PCOUNT_SCOPE "TOP.ibex_top.u_ibex_core.cs_registers_i"
+#define PCOUNT_NUM 13
+
+static const char *pcount_names[PCOUNT_NUM] = {
+    "mcycle", nullptr, "minstret", "lsu_wait", "ifetch_wait", "loads", "stores",
+    "jumps", "branches", "branches_taken", "compressed", "mul_wait", "div_wait",
+};
+
+static const char *pcount_file = nullptr; // JSON report, besides stderr
+
+static void pcount_report()
+{
+    svScope scope = svGetScopeFromName(PCOUNT_SCOPE);
+    if (scope == nullptr)
+    {
+        fprintf(stderr, "pcount: scope %s not found\n", PCOUNT_SCOPE);
+        return;
+    }
+    svSetScope(scope);
+
+    uint64_t values[PCOUNT_NUM] = {};
+    unsigned num = std::min<unsigned>(mhpmcounter_num(), PCOUNT_NUM);
+    for (unsigned i = 0; i < num; i++)
+        values[i] = mhpmcounter_get(i);
+    // the model is parked while the functional simulator runs, which only keeps
+    // mcycle and minstret
+    if (ff.mode == FF_ISS)
+    {
+        values[0] = ff.iss.mcycle;
+        values[2] = ff.iss.minstret;
+    }
+
+    FILE *f = nullptr;
+    if (pcount_file != nullptr and (f = fopen(core_file_path(pcount_file).c_str(), "w")) == nullptr)
+        perror("opening pcount file failed");
+
+    fprintf(stderr, "pcount:");
+    if (f)
+        fprintf(f, "{\"halted\": %s", halted ? "true" : "false");
+    for (unsigned i = 0; i < num; i++)
+    {
+        if (pcount_names[i] == nullptr)
+            continue;
+        fprintf(stderr, " %s=%lu", pcount_names[i], values[i]);
+        if (f)
+            fprintf(f, ", \"%s\": %lu", pcount_names[i], values[i]);
+    }
+    double ipc = values[0] ? double(values[2]) / values[0] : 0.0;
+    fprintf(stderr, " ipc=%.3f\n", ipc);
+    if (f)
+    {
+        fprintf(f, ", \"ipc\": %.6f}\n", ipc);
+        fclose(f);
+    }
+}
+
+/* **************************************************************************
+ * hang detection
+ *
+ * Firmware that faults ends in the endless loop of its exception handler and
+ * never writes the halt register, so the simulation would run until the
+ * orchestration gives up. With --hang-cycles the adapter ends the run when
+ * the core fetches from a range of at most --hang-span bytes without a store
+ * for that many cycles, or retires no instruction for that long while awake.
+ * Loops that touch a range given with --hang-idle wait on purpose and are
+ * left alone. A simulated time and a wall-clock limit end the run as well.
+ * The checks run every HANG_CHECK_INTERVAL cycles. While the functional
+ * simulator runs, only the limits apply.
+ *
+ * For the diagnostic the save program of the functional fast-forward stores
+ * the PC and the trap CSRs of the model, its region at the debug halt address
+ * is mapped for this even without fast-forward. A core that is stuck on a
+ * memory access does not enter debug mode, then only the fetch address is
+ * reported.
+ * ************************************************************************** */
+
+#define HANG_CHECK_INTERVAL 4096
+#define HANG_DUMP_CYCLES 10000 // for the model to store its state
+// exit status of a hung core and of an exceeded limit
+#define HANG_EXIT_HUNG 3
+#define HANG_EXIT_LIMIT 4
+
+enum hang_reason {
+    HANG_NONE,
+    HANG_LOOP,        // tight loop without stores
+    HANG_NO_PROGRESS, // no instruction retired
+    HANG_SIM_LIMIT,
+    HANG_WALL_LIMIT,
+};
+
+static const char *hang_reason_names[] = {"none", "loop", "no_progress", "sim_limit", "wall_limit"};
+
+struct hang_config {
+    uint64_t cycles = 0; // --hang-cycles, 0 disables the loop and progress checks
+    uint32_t span = 64;  // --hang-span
+    std::vector<std::pair<uint32_t, uint32_t>> idle; // --hang-idle, first and last address
+    uint64_t sim_limit = UINT64_MAX;                 // --sim-limit, ps
+    double wall_limit = 0;                           // --wall-limit, s
+
+    bool enabled() const
+    {
+        return cycles != 0 or sim_limit != UINT64_MAX or wall_limit != 0;
+    }
+};
+
+struct hang_state {
+    uint64_t next_check = UINT64_MAX;
+    // fetch addresses since the last store
+    uint32_t loop_lo = 0;
+    uint32_t loop_hi = 0;
+    uint64_t loop_start = 0;
+    uint64_t minstret = 0;
+    uint64_t progress_cycle = 0; // last check that saw an instruction retire
+
+    hang_reason reason = HANG_NONE;
+    uint64_t cycle = 0;    // of the detection
+    uint64_t dump_end = 0; // gives up waiting for the model
+    bool csrs = false;     // mcause, mepc and mtval are valid
+    uint32_t pc = 0;
+    uint32_t mcause = 0;
+    uint32_t mepc = 0;
+    uint32_t mtval = 0;
+};
+
+static hang_config hang_cfg;
+static thread_local hang_state hang;
+
+static bool hang_parse_idle(const char *spec)
+{
+    char *end;
+    uint32_t addr = strtoul(spec, &end, 0);
+    uint32_t size = *end == ':' ? strtoul(end + 1, &end, 0) : 1;
+    if (*end != 0 or size == 0)
+    {
+        fprintf(stderr, "hang: expected ADDR[:SIZE] for an idle loop, got %s\n", spec);
+        return false;
+    }
+    hang_cfg.idle.push_back({addr, addr + (size - 1)});
+    return true;
+}
+
+static bool hang_setup()
+{
+    // fast-forward has mapped the save program already
+    if (not hang_cfg.enabled() or ff_cfg.enabled())
+        return true;
+    return ff_stub_map();
+}
+
+static void hang_start()
+{
+    if (not hang_cfg.enabled())
+        return;
+    hang.next_check = cur_cycle + HANG_CHECK_INTERVAL;
+    hang.loop_start = hang.progress_cycle = cur_cycle;
+}
+
+static inline void hang_loop_restart(uint32_t addr)
+{
+    hang.loop_lo = hang.loop_hi = addr;
+    hang.loop_start = cur_cycle;
+}
+
+static void hang_observe(const Vibex_top &dut)
+{
+    // keep the loop of the diagnostic
+    if (hang.reason != HANG_NONE)
+        return;
+    if (dut.instr_req_o)
+    {
+        uint32_t addr = dut.instr_addr_o;
+        hang.loop_lo = std::min(hang.loop_lo, addr);
+        hang.loop_hi = std::max(hang.loop_hi, addr);
+        if (hang.loop_hi - hang.loop_lo >= hang_cfg.span)
+            hang_loop_restart(addr);
+    }
+    if ((dut.data_req_o and dut.data_we_o) or dut.core_sleep_o)
+        hang_loop_restart(dut.instr_addr_o);
+}
+
+static bool hang_idle_loop()
+{
+    for (const auto &[first, last] : hang_cfg.idle)
+    {
+        if (hang.loop_lo <= last and first <= hang.loop_hi)
+            return true;
+    }
+    return false;
+}
+
+// minstret of the model, false if the counters cannot be read
+static bool hang_minstret(uint64_t &minstret)
+{
+    svScope scope = svGetScopeFromName(PCOUNT_SCOPE);
+    if (scope == nullptr)
+        return false;
+    svSetScope(scope);
+    minstret = mhpmcounter_get(2);
+    return true;
+}
+
+static uint32_t hang_saved_csr(uint32_t csr)
+{
+    for (unsigned i = 0; i < FF_NUM_CSRS; i++)
+    {
+        if (ff_csrs[i] == csr)
+            return ff_word(FF_CSRS + i);
+    }
+    return 0;
+}
+
+static void hang_detected(Vibex_top &dut, hang_reason reason)
+{
+    hang.reason = reason;
+    hang.cycle = cur_cycle;
+    hang.pc = dut.instr_addr_o;
+    if (ff.mode == FF_ISS)
+    {
+        hang.pc = ff.iss.pc;
+        hang.mcause = ff.iss.mcause;
+        hang.mepc = ff.iss.mepc;
+        hang.mtval = ff.iss.mtval;
+        hang.csrs = true;
+        exiting = true;
+        return;
+    }
+    if (ff.mode != FF_OFF and ff.mode != FF_RTL)
+    {
+        // in the middle of a handoff, the state is in neither place
+        exiting = true;
+        return;
+    }
+
+    // the model stores its state, keep ff_poll from ending a sampling window
+    ff.next_check = UINT64_MAX;
+    ff_word(FF_STATUS) = 0;
+    ff_word(FF_CMD) = 0;
+    dut.debug_req_i = 1;
+    hang.dump_end = cur_cycle + HANG_DUMP_CYCLES;
+    hang.next_check = cur_cycle;
+}
+
+// waits for the state of the model after a detection
+static void hang_dump_poll(Vibex_top &dut)
+{
+    if (ff_word(FF_STATUS) == FF_STATUS_SAVED)
+    {
+        hang.pc = ff_word(FF_PC);
+        hang.mcause = hang_saved_csr(RV32_CSR_MCAUSE);
+        hang.mepc = hang_saved_csr(RV32_CSR_MEPC);
+        hang.mtval = hang_saved_csr(RV32_CSR_MTVAL);
+        hang.csrs = true;
+    }
+    else if (cur_cycle < hang.dump_end)
+    {
+        hang.next_check = cur_cycle + 1;
+        return;
+    }
+    dut.debug_req_i = 0;
+    exiting = true;
+}
+
+// the reason the run has to end, if any
+static hang_reason hang_test(const Vibex_top &dut)
+{
+    if (main_time >= hang_cfg.sim_limit)
+        return HANG_SIM_LIMIT;
+    if (hang_cfg.wall_limit != 0 and stats_wall_s() >= hang_cfg.wall_limit)
+        return HANG_WALL_LIMIT;
+    if (hang_cfg.cycles == 0)
+        return HANG_NONE;
+
+    bool progress = true;
+    uint64_t minstret;
+    if (ff.mode != FF_ISS and not dut.core_sleep_o and hang_minstret(minstret))
+    {
+        progress = minstret != hang.minstret;
+        hang.minstret = minstret;
+    }
+    if (progress)
+        hang.progress_cycle = cur_cycle;
+    else if (cur_cycle - hang.progress_cycle >= hang_cfg.cycles)
+        return HANG_NO_PROGRESS;
+
+    // the model is parked while the simulator runs
+    if (ff.mode == FF_ISS)
+        hang.loop_start = cur_cycle;
+    else if (cur_cycle - hang.loop_start >= hang_cfg.cycles and not hang_idle_loop())
+        return HANG_LOOP;
+    return HANG_NONE;
+}
+
+static void hang_check(Vibex_top &dut)
+{
+    if (hang.reason != HANG_NONE)
+    {
+        hang_dump_poll(dut);
+        return;
+    }
+    hang.next_check = cur_cycle + HANG_CHECK_INTERVAL;
+    hang_reason reason = hang_test(dut);
+    if (reason != HANG_NONE)
+        hang_detected(dut, reason);
+}
+
+static void hang_print()
+{
+    fprintf(stderr, "hang: reason=%s cycle=%lu pc=%#x", hang_reason_names[hang.reason], hang.cycle, hang.pc);
+    if (hang.reason == HANG_LOOP)
+        fprintf(stderr, " loop=%#x-%#x", hang.loop_lo, hang.loop_hi);
+    if (hang.csrs)
+        fprintf(stderr, " mcause=%#x mepc=%#x mtval=%#x", hang.mcause, hang.mepc, hang.mtval);
+    fprintf(stderr, "\n");
+}
+
+static int hang_exit_status()
+{
+    switch (hang.reason)
+    {
+    case HANG_NONE:
+        return EXIT_SUCCESS;
+    case HANG_LOOP:
+    case HANG_NO_PROGRESS:
+        return HANG_EXIT_HUNG;
+    default:
+        return HANG_EXIT_LIMIT;
+    }
+}
+
+/* **************************************************************************
+ * checkpoints
+ *
+ * A checkpoint holds the Verilated model (built with --savable), the
+ * transaction table, the delayed responses, time, the timer, the instruction
+ * cache and the contents of the local memory ranges. Messages on the memory
+ * channel cannot be saved, so a requested checkpoint is written at the first
+ * cycle without requests in flight on the channel. The state of the peers is
+ * not part of it either, a restored run is only exact if the memory contents
+ * live in local memory or the peers start from the same state.
+ * ************************************************************************** */
+
+#define CKPT_MAGIC 0x54504b4358454249ULL // "IBEXCKPT"
+#define CKPT_VERSION 2
+
+struct checkpoint_state {
+    const char *path = nullptr;
+    uint64_t at = UINT64_MAX; // simulated time, reset once written
+    bool exit = false;        // end the simulation after writing
+};
+
+static checkpoint_state ckpt;
+
+#if IBEX_SAVABLE
+static volatile sig_atomic_t ckpt_request = 0;
+static void sighup_handler([[maybe_unused]] int _dummy)
+{
+    ckpt_request = 1;
+}
+
+static_assert(std::is_trivially_copyable<mem_txn>::value and std::is_trivially_copyable<port_queue>::value and
+              std::is_trivially_copyable<delayed>::value);
+
+template <typename T> static inline void ckpt_write(VerilatedSerialize &os, const T &value)
+{
+    os.write(&value, sizeof(value));
+}
+
+template <typename T> static inline void ckpt_read(VerilatedDeserialize &is, T &value)
+{
+    is.read(&value, sizeof(value));
+}
+
+static bool ckpt_quiescent()
+{
+    if (wcb.len != 0)
+        return false;
+    for (const mem_txn &txn : txns)
+    {
+        if (txn.state == TXN_UNSENT or txn.state == TXN_ISSUED)
+            return false;
+    }
+    return true;
+}
+
+static void ckpt_save_cache(VerilatedSerialize &os, const mem_cache &c)
+{
+    ckpt_write(os, c.size);
+    ckpt_write(os, c.line_size);
+    if (c.size != 0)
+    {
+        os.write(c.tags.data(), c.tags.size() * sizeof(c.tags[0]));
+        os.write(c.data.data(), c.data.size());
+        for (bool valid : c.valid)
+            ckpt_write(os, valid);
+    }
+}
+
+static bool ckpt_restore_cache(VerilatedDeserialize &is, mem_cache &c, const char *name)
+{
+    uint32_t size, line_size;
+    ckpt_read(is, size);
+    ckpt_read(is, line_size);
+    if (size != c.size or (size != 0 and line_size != c.line_size))
+    {
+        fprintf(stderr, "ckpt_restore: %s configuration differs from the checkpoint\n", name);
+        return false;
+    }
+    if (c.size != 0)
+    {
+        is.read(c.tags.data(), c.tags.size() * sizeof(c.tags[0]));
+        is.read(c.data.data(), c.data.size());
+        for (size_t i = 0; i < c.valid.size(); i++)
+        {
+            bool valid;
+            ckpt_read(is, valid);
+            c.valid[i] = valid;
+        }
+    }
+    return true;
+}
+
+static bool ckpt_save(Vibex_top &dut, const delayed &delay)
+{
+    VerilatedSave os;
+    os.open(ckpt.path);
+    if (not os.isOpen())
+    {
+        fprintf(stderr, "ckpt_save: opening %s failed\n", ckpt.path);
+        return false;
+    }
+
+    ckpt_write(os, CKPT_MAGIC);
+    ckpt_write(os, CKPT_VERSION);
+    ckpt_write(os, main_time);
+    ckpt_write(os, cur_cycle);
+    ckpt_write(os, delay);
+    ckpt_write(os, txns);
+    ckpt_write(os, txn_next);
+    ckpt_write(os, ports);
+    ckpt_write(os, timer.mtime_offset);
+    ckpt_write(os, timer.mtimecmp);
+
+    ckpt_save_cache(os, icache);
+    ckpt_save_cache(os, dcache);
+
+    ckpt_write(os, local_regions.size());
+    for (const local_region &r : local_regions)
+    {
+        ckpt_write(os, r.base);
+        ckpt_write(os, r.size);
+        os.write(r.mem, r.size);
+    }
+
+    os << dut;
+    os.close();
+    fprintf(stderr, "ckpt: saved %s at main_time=%lu cycle=%lu\n", ckpt.path, main_time, cur_cycle);
+    return true;
+}
+
+// the adapter has to be configured as when the checkpoint was written
+static bool ckpt_restore(const char *path, Vibex_top &dut, delayed &delay)
+{
+    VerilatedRestore is;
+    is.open(path);
+    if (not is.isOpen())
+    {
+        fprintf(stderr, "ckpt_restore: opening %s failed\n", path);
+        return false;
+    }
+
+    uint64_t magic;
+    int version;
+    ckpt_read(is, magic);
+    ckpt_read(is, version);
+    if (magic != CKPT_MAGIC or version != CKPT_VERSION)
+    {
+        fprintf(stderr, "ckpt_restore: %s is not a checkpoint of this adapter version\n", path);
+        return false;
+    }
+    ckpt_read(is, main_time);
+    ckpt_read(is, cur_cycle);
+    ckpt_read(is, delay);
+    ckpt_read(is, txns);
+    ckpt_read(is, txn_next);
+    ckpt_read(is, ports);
+    ckpt_read(is, timer.mtime_offset);
+    ckpt_read(is, timer.mtimecmp);
+
+    if (not ckpt_restore_cache(is, icache, "instruction cache") or
+        not ckpt_restore_cache(is, dcache, "data cache"))
+        return false;
+
+    size_t num_regions;
+    ckpt_read(is, num_regions);
+    if (num_regions != local_regions.size())
+    {
+        fprintf(stderr, "ckpt_restore: local memory ranges differ from the checkpoint\n");
+        return false;
+    }
+    for (local_region &r : local_regions)
+    {
+        uint32_t base, size;
+        ckpt_read(is, base);
+        ckpt_read(is, size);
+        if (base != r.base or size != r.size)
+        {
+            fprintf(stderr, "ckpt_restore: local memory ranges differ from the checkpoint\n");
+            return false;
+        }
+        is.read(r.mem, r.size);
+    }
+
+    is >> dut;
+    is.close();
+    fprintf(stderr, "ckpt: restored %s at main_time=%lu cycle=%lu\n", path, main_time, cur_cycle);
+    return true;
+}
+
+// called from the main loop once a checkpoint is due
+static void ckpt_poll(Vibex_top &dut, const delayed &delay)
 {
-
-    volatile union SimbricksProtoMemM2H *msg = SimbricksMemIfM2HInPoll(&memif, cur_ts);
-    if (msg == nullptr)
+    if (ckpt_request)
     {
-#if IBEX_VERILATOR_DEBUG
-//      sim_log::LogWarn("poll_mem_to_core msg nullptr\n");
-#endif
-        return;
+        ckpt_request = 0;
+        ckpt.at = main_time;
     }
-
-    uint8_t type = SimbricksMemIfM2HInType(&memif, msg);
-    switch (type)
+    if (not ckpt_quiescent())
     {
-    case SIMBRICKS_PROTO_MEM_M2H_MSG_READCOMP:
-    {
-        volatile struct SimbricksProtoMemM2HReadcomp &readcomp = msg->readcomp;
-        if (readcomp.req_id == INSTR_REQ_ID)
-        {
-            assert(!delay.instr_rvalid_i);
-            delay.instr_rvalid_i = 1;
-            memcpy(&delay.instr_rdata_i, const_cast<uint8_t *>(readcomp.data), 4);
-            pending_instr_req = false;
-#if IBEX_VERILATOR_DEBUG
-            sim_log::LogInfo("[%lu] poll_mem_to_core inst mem read complete (%x)\n", main_time, dut.instr_rdata_i);
-            sim_log::FlushLog();
+        // buffered stores go out first
+        if (wcb.len != 0)
+            wcb.flush = true;
+        return;
+    }
+    ckpt.at = UINT64_MAX;
+    if (ckpt_save(dut, delay) and ckpt.exit)
+        exiting = true;
+}
 #endif
-        }
-        else
-        {
-            assert(readcomp.req_id == DATA_REQ_ID);
-            assert(!delay.data_rvalid_i);
-            delay.data_rvalid_i = 1;
-            memcpy(&delay.data_rdata_i, const_cast<uint8_t *>(readcomp.data), 4);
-            pending_data = false;
-#if IBEX_VERILATOR_DEBUG
-            sim_log::LogInfo("[%lu] poll_mem_to_core data mem read complete (%x)\n", main_time, dut.data_rdata_i);
-            sim_log::FlushLog();
+
+// next simulated time at which a checkpoint or the trace window is due, the
+// WFI skip does not jump past it
+static uint64_t time_event_next()
+{
+    uint64_t t = UINT64_MAX;
+#if IBEX_SAVABLE
+    if (ckpt.path != nullptr and ckpt.at > main_time)
+        t = ckpt.at;
 #endif
-        }
-        break;
-    }
-    case SIMBRICKS_PROTO_MEM_M2H_MSG_WRITECOMP:
-        // NOTE: currently we only support posted writes
-        break;
-    case SIMBRICKS_PROTO_MSG_TYPE_SYNC:
-        break;
-    default:
-        sim_log::LogError("poll_mem_to_core: unsupported type=%d", type);
+    if (trace.check)
+    {
+        if (trace.start > main_time)
+            t = std::min(t, trace.start);
+        else if (trace.stop > main_time)
+            t = std::min(t, trace.stop);
     }
-
-    SimbricksMemIfM2HInDone(&memif, msg);
+    return t;
 }
 
 void init_dut(Vibex_top &dut, delayed &delay)
@@ -233,8 +3785,8 @@ void init_dut(Vibex_top &dut, delayed &delay)
 
     dut.scan_rst_ni = 1;
 
-    dut.hart_id_i = 0;
-    dut.boot_addr_i = 0x00100080;
+    dut.hart_id_i = core_id;
+    dut.boot_addr_i = IBEX_BOOT_ADDR;
 
     // Instruction memory interface
     // output logic instr_req_o,
@@ -307,52 +3859,53 @@ void CheckAlerts(Vibex_top &dut)
   }
 }
 
-bool MemifInit(struct SimbricksMemIf &memif, struct SimbricksAdapterParams *memAdapterParams)
+// connects all channels and exchanges the intro messages on them together
+bool MemifInit(mem_channel *channels, unsigned n)
 {
-    struct SimbricksBaseIfParams memParams;
-    SimbricksMemIfDefaultParams(&memParams);
-    if (memAdapterParams->sync_interval_set)
-    {
-        memParams.sync_interval = memAdapterParams->sync_interval * 1000ULL;
-    }
-    if (memAdapterParams->link_latency_set)
-    {
-        memParams.link_latency = memAdapterParams->link_latency * 1000ULL;
-    }
-    memParams.sock_path = memAdapterParams->socket_path;
-    memParams.sync_mode = memAdapterParams->sync ? kSimbricksBaseIfSyncRequired : kSimbricksBaseIfSyncDisabled;
-    memParams.blocking_conn = true;
+    struct SimBricksBaseIfEstablishData ests[MAX_CHANNELS];
+    struct SimbricksProtoMemHostIntro m_intros[MAX_CHANNELS];
+    struct SimbricksProtoMemHostIntro h_intros[MAX_CHANNELS];
 
-    struct SimbricksBaseIf *membase = &memif.base;
-    struct SimbricksBaseIfSHMPool pool_;
-    memset(&pool_, 0, sizeof(pool_));
-
-    struct SimBricksBaseIfEstablishData ests[1];
-    struct SimbricksProtoMemHostIntro m_intro;
-    struct SimbricksProtoMemHostIntro h_intro;
-    unsigned n_bifs = 0;
+    for (unsigned c = 0; c < n; c++)
+    {
+        struct SimbricksAdapterParams *memAdapterParams = channels[c].params;
+        struct SimbricksBaseIfParams memParams;
+        SimbricksMemIfDefaultParams(&memParams);
+        if (memAdapterParams->sync_interval_set)
+        {
+            memParams.sync_interval = memAdapterParams->sync_interval * 1000ULL;
+        }
+        if (memAdapterParams->link_latency_set)
+        {
+            memParams.link_latency = memAdapterParams->link_latency * 1000ULL;
+        }
+        memParams.sock_path = memAdapterParams->socket_path;
+        memParams.sync_mode = memAdapterParams->sync ? kSimbricksBaseIfSyncRequired : kSimbricksBaseIfSyncDisabled;
+        memParams.blocking_conn = true;
+        channels[c].sync = memAdapterParams->sync;
 
-    memset(&m_intro, 0, sizeof(m_intro));
-    ests[n_bifs].base_if = membase;
-    ests[n_bifs].tx_intro = &m_intro;
-    ests[n_bifs].tx_intro_len = sizeof(m_intro);
-    ests[n_bifs].rx_intro = &h_intro;
-    ests[n_bifs].rx_intro_len = sizeof(h_intro);
-    n_bifs++;
+        struct SimbricksBaseIf *membase = &channels[c].memif.base;
+        memset(&m_intros[c], 0, sizeof(m_intros[c]));
+        ests[c].base_if = membase;
+        ests[c].tx_intro = &m_intros[c];
+        ests[c].tx_intro_len = sizeof(m_intros[c]);
+        ests[c].rx_intro = &h_intros[c];
+        ests[c].rx_intro_len = sizeof(h_intros[c]);
 
-    if (SimbricksBaseIfInit(membase, &memParams))
-    {
-        perror("Init: SimbricksBaseIfInit failed");
-        return false;
-    }
+        if (SimbricksBaseIfInit(membase, &memParams))
+        {
+            perror("Init: SimbricksBaseIfInit failed");
+            return false;
+        }
 
-    if (SimbricksBaseIfConnect(membase) != 0)
-    {
-        perror("MemifInit: SimbricksBaseIfConnect failed");
-        return false;
+        if (SimbricksBaseIfConnect(membase) != 0)
+        {
+            perror("MemifInit: SimbricksBaseIfConnect failed");
+            return false;
+        }
     }
 
-    if (SimBricksBaseIfEstablish(ests, 1))
+    if (SimBricksBaseIfEstablish(ests, n))
     {
         fprintf(stderr, "SimBricksBaseIfEstablish failed\n");
         return false;
@@ -364,111 +3917,984 @@ bool MemifInit(struct SimbricksMemIf &memif, struct SimbricksAdapterParams *memA
     return true;
 }
 
-int main(int argc, char *argv[])
+enum {
+    OPT_ICACHE_SIZE = 256,
+    OPT_ICACHE_LINE,
+    OPT_ICACHE_HIT_LATENCY,
+    OPT_DCACHE_SIZE,
+    OPT_DCACHE_LINE,
+    OPT_DCACHE_HIT_LATENCY,
+    OPT_CACHEABLE,
+    OPT_WCB_SIZE,
+    OPT_WCB_TIMEOUT,
+    OPT_LOCAL_MEM,
+    OPT_LOCAL_ELF,
+    OPT_LOCAL_MEM_LATENCY,
+    OPT_NO_WFI_SKIP,
+    OPT_TIMER_BASE,
+    OPT_NO_TIMER,
+    OPT_TRACE,
+    OPT_TRACE_LEVEL,
+    OPT_TRACE_START,
+    OPT_TRACE_STOP,
+    OPT_TRACE_PC,
+    OPT_TRACE_ADDR,
+    OPT_STATS_FILE,
+    OPT_STATS_INTERVAL,
+    OPT_PCOUNT_FILE,
+    OPT_CHECKPOINT,
+    OPT_CHECKPOINT_AT,
+    OPT_CHECKPOINT_EXIT,
+    OPT_RESTORE,
+    OPT_NO_CHAN_BATCH,
+    OPT_INSTR_MEM,
+    OPT_CORE_MEM,
+    OPT_CORE_QUANTUM,
+    OPT_SIM_CTRL_BASE,
+    OPT_CONSOLE,
+    OPT_FF_INSNS,
+    OPT_FF_UNTIL_PC,
+    OPT_FF_UNTIL,
+    OPT_FF_WINDOW,
+    OPT_FF_PERIOD,
+    OPT_FF_DM_ADDR,
+    OPT_RVFI_TRACE,
+    OPT_PROFILE,
+    OPT_PROFILE_INTERVAL,
+    OPT_PROFILE_ELF,
+    OPT_PROFILE_FORMAT,
+    OPT_MEM_STATS,
+    OPT_MEM_STATS_ELF,
+    OPT_MEM_STATS_LINE,
+    OPT_MEM_STATS_PAGE,
+    OPT_MEM_STATS_STACK,
+    OPT_RECORD,
+    OPT_REPLAY,
+    OPT_HANG_CYCLES,
+    OPT_HANG_SPAN,
+    OPT_HANG_IDLE,
+    OPT_SIM_LIMIT,
+    OPT_WALL_LIMIT,
+};
+
+static const struct option long_options[] = {
+    {"icache-size", required_argument, nullptr, OPT_ICACHE_SIZE},
+    {"icache-line", required_argument, nullptr, OPT_ICACHE_LINE},
+    {"icache-hit-latency", required_argument, nullptr, OPT_ICACHE_HIT_LATENCY},
+    {"dcache-size", required_argument, nullptr, OPT_DCACHE_SIZE},
+    {"dcache-line", required_argument, nullptr, OPT_DCACHE_LINE},
+    {"dcache-hit-latency", required_argument, nullptr, OPT_DCACHE_HIT_LATENCY},
+    {"cacheable", required_argument, nullptr, OPT_CACHEABLE},
+    {"wcb-size", required_argument, nullptr, OPT_WCB_SIZE},
+    {"wcb-timeout", required_argument, nullptr, OPT_WCB_TIMEOUT},
+    {"local-mem", required_argument, nullptr, OPT_LOCAL_MEM},
+    {"local-elf", required_argument, nullptr, OPT_LOCAL_ELF},
+    {"local-mem-latency", required_argument, nullptr, OPT_LOCAL_MEM_LATENCY},
+    {"no-wfi-skip", no_argument, nullptr, OPT_NO_WFI_SKIP},
+    {"timer-base", required_argument, nullptr, OPT_TIMER_BASE},
+    {"no-timer", no_argument, nullptr, OPT_NO_TIMER},
+    {"trace", required_argument, nullptr, OPT_TRACE},
+    {"trace-level", required_argument, nullptr, OPT_TRACE_LEVEL},
+    {"trace-start", required_argument, nullptr, OPT_TRACE_START},
+    {"trace-stop", required_argument, nullptr, OPT_TRACE_STOP},
+    {"trace-pc", required_argument, nullptr, OPT_TRACE_PC},
+    {"trace-addr", required_argument, nullptr, OPT_TRACE_ADDR},
+    {"stats-file", required_argument, nullptr, OPT_STATS_FILE},
+    {"stats-interval", required_argument, nullptr, OPT_STATS_INTERVAL},
+    {"pcount-file", required_argument, nullptr, OPT_PCOUNT_FILE},
+    {"checkpoint", required_argument, nullptr, OPT_CHECKPOINT},
+    {"checkpoint-at", required_argument, nullptr, OPT_CHECKPOINT_AT},
+    {"checkpoint-exit", no_argument, nullptr, OPT_CHECKPOINT_EXIT},
+    {"restore", required_argument, nullptr, OPT_RESTORE},
+    {"no-chan-batch", no_argument, nullptr, OPT_NO_CHAN_BATCH},
+    {"instr-mem", required_argument, nullptr, OPT_INSTR_MEM},
+    {"core-mem", required_argument, nullptr, OPT_CORE_MEM},
+    {"core-quantum", required_argument, nullptr, OPT_CORE_QUANTUM},
+    {"sim-ctrl-base", required_argument, nullptr, OPT_SIM_CTRL_BASE},
+    {"console", required_argument, nullptr, OPT_CONSOLE},
+    {"ff-insns", required_argument, nullptr, OPT_FF_INSNS},
+    {"ff-until-pc", required_argument, nullptr, OPT_FF_UNTIL_PC},
+    {"ff-until", required_argument, nullptr, OPT_FF_UNTIL},
+    {"ff-window", required_argument, nullptr, OPT_FF_WINDOW},
+    {"ff-period", required_argument, nullptr, OPT_FF_PERIOD},
+    {"ff-dm-addr", required_argument, nullptr, OPT_FF_DM_ADDR},
+    {"rvfi-trace", required_argument, nullptr, OPT_RVFI_TRACE},
+    {"profile", required_argument, nullptr, OPT_PROFILE},
+    {"profile-interval", required_argument, nullptr, OPT_PROFILE_INTERVAL},
+    {"profile-elf", required_argument, nullptr, OPT_PROFILE_ELF},
+    {"profile-format", required_argument, nullptr, OPT_PROFILE_FORMAT},
+    {"mem-stats", required_argument, nullptr, OPT_MEM_STATS},
+    {"mem-stats-elf", required_argument, nullptr, OPT_MEM_STATS_ELF},
+    {"mem-stats-line", required_argument, nullptr, OPT_MEM_STATS_LINE},
+    {"mem-stats-page", required_argument, nullptr, OPT_MEM_STATS_PAGE},
+    {"mem-stats-stack", required_argument, nullptr, OPT_MEM_STATS_STACK},
+    {"record", required_argument, nullptr, OPT_RECORD},
+    {"replay", required_argument, nullptr, OPT_REPLAY},
+    {"hang-cycles", required_argument, nullptr, OPT_HANG_CYCLES},
+    {"hang-span", required_argument, nullptr, OPT_HANG_SPAN},
+    {"hang-idle", required_argument, nullptr, OPT_HANG_IDLE},
+    {"sim-limit", required_argument, nullptr, OPT_SIM_LIMIT},
+    {"wall-limit", required_argument, nullptr, OPT_WALL_LIMIT},
+    {nullptr, 0, nullptr, 0},
+};
+
+static void usage()
 {
-    signal(SIGINT, sigint_handler);
-    signal(SIGUSR1, sigusr1_handler);
+    fprintf(stderr,
+            "Usage: ibex_simbricks [OPTIONS] MEM-PARAMS [START-TICK] [CLOCK-FREQ-MHZ] [+verilator+...]\n"
+            "Options:\n"
+            "  --icache-size=BYTES         enable adapter instruction cache (default: off)\n"
+            "  --icache-line=BYTES         instruction cache line size (default: 32)\n"
+            "  --icache-hit-latency=CYCLES cycles from grant to rvalid on a hit (default: 1)\n"
+            "  --dcache-size=BYTES         enable write-through data cache for --cacheable ranges\n"
+            "  --dcache-line=BYTES         data cache line size (default: 32)\n"
+            "  --dcache-hit-latency=CYCLES cycles from grant to rvalid on a data cache hit (default: 1)\n"
+            "  --cacheable=BASE:SIZE       range the data cache and write combining apply to\n"
+            "                              (repeatable)\n"
+            "  --wcb-size=BYTES            combine stores to --cacheable ranges into writes of up\n"
+            "                              to BYTES (default: off)\n"
+            "  --wcb-timeout=CYCLES        write the combined stores out after this many cycles\n"
+            "                              (default: 64)\n"
+            "  --local-mem=BASE:SIZE[:IMAGE]\n"
+            "                              serve range from adapter memory, optionally\n"
+            "                              initialized from a raw image (repeatable)\n"
+            "  --local-elf=FILE            load ELF segments into the local ranges\n"
+            "  --local-mem-latency=CYCLES  cycles from grant to rvalid for local memory (default: 1)\n"
+            "  --no-wfi-skip               evaluate every cycle while the core sleeps in WFI\n"
+            "  --timer-base=ADDR           base address of the adapter timer (default: 0x30000)\n"
+            "  --no-timer                  leave the timer range to the memory channel\n"
+            "  --sim-ctrl-base=ADDR        base address of the simulation control block\n"
+            "                              (default: 0x20000)\n"
+            "  --console=FILE              serve the character output register in the adapter\n"
+            "                              and write the output to FILE, - for stdout\n"
+            "  --ff-insns=N                run the first N instructions in the functional simulator\n"
+            "  --ff-until-pc=ADDR          ... or until the first time the PC reaches ADDR\n"
+            "  --ff-until=PS               ... or until this simulated time\n"
+            "  --ff-window=CYCLES          sample: simulate windows of CYCLES in the model ...\n"
+            "  --ff-period=N               ... and N instructions functionally between them\n"
+            "  --ff-dm-addr=ADDR           debug halt address of the model (default: 0x1a110800)\n"
+            "  --trace=FILE                write a waveform trace (SIGUSR2 toggles tracing)\n"
+            "  --trace-level=N             hierarchy depth to trace (default: 40)\n"
+            "  --trace-start=PS            start tracing at this simulated time\n"
+            "  --trace-stop=PS             stop tracing at this simulated time\n"
+            "  --trace-pc=ADDR             start tracing on a fetch from ADDR\n"
+            "  --trace-addr=ADDR           start tracing on a data access to ADDR\n"
+            "  --rvfi-trace=FILE           write a binary trace of the retired instructions\n"
+            "                              (rvfi build variant)\n"
+            "  --profile=FILE              sample the guest PC and write a profile at exit\n"
+            "  --profile-interval=CYCLES   cycles between samples (default: 1000)\n"
+            "  --profile-elf=FILE          symbols for the profile (default: --local-elf)\n"
+            "  --profile-format=FORMAT     flat (default) or folded stacks for flame graphs\n"
+            "  --mem-stats=FILE            write memory access statistics per region and page,\n"
+            "                              and stack distance histograms, as JSON at exit\n"
+            "  --mem-stats-elf=FILE        sections for the regions (default: --local-elf)\n"
+            "  --mem-stats-line=BYTES      line size of the stack distances (default: 32)\n"
+            "  --mem-stats-page=BYTES      page size of the heatmap (default: 4096)\n"
+            "  --mem-stats-stack=BASE:SIZE stack region (default: 0x130000:0x8000)\n"
+            "  --stats-file=FILE           append statistics as JSON lines to FILE\n"
+            "  --stats-interval=CYCLES     cycles between statistics lines (default: 1000000)\n"
+            "  --pcount-file=FILE          write the guest performance counters at exit as JSON\n"
+            "  --checkpoint=FILE           write a checkpoint to FILE (SIGHUP requests one)\n"
+            "  --checkpoint-at=PS          write the checkpoint at this simulated time\n"
+            "  --checkpoint-exit           end the simulation after writing the checkpoint\n"
+            "  --restore=FILE              resume from a checkpoint\n"
+            "  --no-chan-batch             sync and poll the memory channel every cycle\n"
+            "  --instr-mem=MEM-PARAMS      separate memory interface for instruction fetches,\n"
+            "                              once per core\n"
+            "  --core-mem=MEM-PARAMS       add a core with this memory interface (repeatable)\n"
+            "  --record=FILE               log the messages from the memory side for --replay\n"
+            "  --replay=FILE               replay a log instead of connecting to the memory side,\n"
+            "                              with the options of the recorded run (MEM-PARAMS unused)\n"
+            "  --hang-cycles=N             end the run after N cycles in a loop without stores or\n"
+            "                              without retiring an instruction (exit status 3)\n"
+            "  --hang-span=BYTES           largest loop the detection considers (default: 64)\n"
+            "  --hang-idle=ADDR[:SIZE]     loops touching this range are idle on purpose (repeatable)\n"
+            "  --sim-limit=PS              end the run at this simulated time (exit status 4)\n"
+            "  --wall-limit=SECONDS        end the run after this wall-clock time (exit status 4)\n"
+            "  --core-quantum=CYCLES       cycles between barriers of the cores\n"
+            "                              (default: sync interval)\n");
+}
 
-#if IBEX_VERILATOR_DEBUG
-    sim_log::LogRegistry().SetFlush(true);
-#endif
+/* **************************************************************************
+ * multiple cores
+ *
+ * With --core-mem the adapter runs further Ibex cores in the same process.
+ * Each core has its own model, hart ID, memory channels and copy of the
+ * adapter state: transaction table, caches, timer, local memory
+ * and statistics. That state is thread_local and every core runs the main
+ * loop on its own thread. The cores only interact through their memory
+ * channels, whose synchronization already keeps them consistent in simulated
+ * time. A barrier every core_quantum cycles bounds how far the threads drift
+ * apart on the host, so a core does not run ahead while the others wait for
+ * their peers.
+ * ************************************************************************** */
 
-    auto dut = std::make_unique<Vibex_top>();
-#if IBEX_VERILATOR_TRACE
-    auto trace = std::make_unique<VerilatedVcdC>();
-    Verilated::traceEverOn(true);
-    dut->trace(trace.get(), IBEX_VERILATOR_TRACE_LEVEL);
-    trace->open("ibex-verilator-debug.vcd");
-#endif
+static uint64_t core_quantum = 0; // cycles between barriers, 0 selects the sync interval
+static thread_local uint64_t core_next_barrier = UINT64_MAX;
 
-    // argument parsing and initialization
-    uint64_t clock_period = 4 * 1000ULL; // 4ns -> 250MHz
-    if (argc < 2 or argc > 4)
+struct core_barrier {
+    std::atomic<unsigned> waiting{0};
+    std::atomic<uint64_t> generation{0};
+};
+
+static core_barrier barrier;
+
+// returns once all cores that did not halt arrived or the simulation ends
+static void core_barrier_wait()
+{
+    uint64_t gen = barrier.generation.load(std::memory_order_acquire);
+    barrier.waiting.fetch_add(1, std::memory_order_acq_rel);
+    for (unsigned spins = 0; barrier.generation.load(std::memory_order_acquire) == gen and not exiting; spins++)
     {
-        fprintf(stderr, "Usage: ibex_simbricks MEM-PARAMS [START-TICK] [CLOCK-FREQ-MHZ]\n");
-        return EXIT_FAILURE;
+        // a core that halts while the others wait lowers the count, so every
+        // waiter checks it. Cores only arrive for the next generation once it
+        // started, so the reset cannot lose an arrival.
+        unsigned waiting = barrier.waiting.load(std::memory_order_acquire);
+        if (waiting >= num_cores - cores_halted.load(std::memory_order_acquire) and
+            barrier.waiting.compare_exchange_strong(waiting, 0, std::memory_order_acq_rel))
+        {
+            barrier.generation.store(gen + 1, std::memory_order_release);
+            return;
+        }
+        // with more cores than host CPUs the last one has to get a chance to arrive
+        if (spins >= 1024)
+            std::this_thread::yield();
     }
-    if (argc == 3)
+}
+
+// a WFI fast-forward may have skipped over several barriers
+static void core_barrier_poll()
+{
+    while (cur_cycle >= core_next_barrier and not exiting)
+    {
+        core_barrier_wait();
+        core_next_barrier += core_quantum;
+    }
+}
+
+/* A core that halted stops evaluating its model and leaves the barriers, but
+ * keeps its channels going: the peers of a synchronized channel wait for its
+ * syncs until the last core halted and the simulation ends. */
+static void core_halt_idle(uint64_t clock_period)
+{
+    // stores the core issued before the halt still go out
+    txn_send_unsent(main_time);
+    if (wcb.len != 0)
+        wcb_drain(main_time);
+    uint64_t target = UINT64_MAX;
+    for (unsigned c = 0; c < num_chans; c++)
     {
-        main_time = strtoull(argv[2], NULL, 0);
+        if (chans[c].sync and main_time >= chans[c].next_sync)
+            chan_sync(chans[c]);
+        if (main_time >= chans[c].next_poll)
+            chan_drain(chans[c]);
+        if (chans[c].sync)
+            target = std::min({target, chans[c].next_sync, chans[c].next_poll});
     }
-    if (argc == 4)
+    if (target == UINT64_MAX)
     {
-        clock_period = 1000000ULL / strtoull(argv[3], NULL, 0);
+        // nothing to keep up with
+        main_time += WFI_MAX_SKIP_CYCLES * clock_period;
     }
+    else
+    {
+        uint64_t cycles = target > main_time ? (target - main_time + clock_period - 1) / clock_period : 1;
+        main_time += cycles * clock_period;
+    }
+    // a halted core only keeps its channels alive, leave the host to the running ones
+    std::this_thread::yield();
+}
+
+struct core_setup {
+    const char *mem_params;
+    const char *instr_mem_params; // nullptr without Harvard mode
+    uint64_t start_time;
+    uint64_t clock_period;
+    const char *restore_path;
+    int argc; // for the Verilator plusargs
+    char **argv;
+};
+
+// runs one core until the simulation ends, on the calling thread
+static int core_run(const core_setup &setup)
+{
+    main_time = setup.start_time;
+    uint64_t clock_period = setup.clock_period;
 
-    struct SimbricksAdapterParams *memAdapterParams = nullptr;
-    memAdapterParams = SimbricksParametersParse(argv[1]);
-    if (not memAdapterParams)
+    for (const char *spec : local_mem_specs)
+    {
+        if (not local_mem_add(spec))
+            return EXIT_FAILURE;
+    }
+    if (local_elf != nullptr and not local_mem_load_elf(local_elf))
+    {
+        return EXIT_FAILURE;
+    }
+    if (not mmio_setup() or not ms_setup() or not ff_setup(core_id) or not hang_setup() or
+        not rvfi_open())
     {
-        fprintf(stderr, "Failed to parse mem parameters\n");
         return EXIT_FAILURE;
     }
+    if (stats_path != nullptr)
+    {
+        stats.file = fopen(core_file_path(stats_path).c_str(), "w");
+        if (stats.file == nullptr)
+        {
+            perror("opening stats file failed");
+            return EXIT_FAILURE;
+        }
+    }
 
-    // initialize SimBricks memory protocol
-    struct SimbricksMemIf memif;
-    if (not MemifInit(memif, memAdapterParams))
+    // a context per core keeps the models and their DPI scopes apart
+    auto context = std::make_unique<VerilatedContext>();
+    context->commandArgs(setup.argc, setup.argv);
+#if VM_TRACE
+    context->traceEverOn(true);
+#endif
+    Verilated::threadContextp(context.get());
+    auto dut = std::make_unique<Vibex_top>(context.get());
+#if VM_TRACE
+    if (core_id == 0)
+    {
+        trace.file = std::make_unique<trace_file>();
+        dut->trace(trace.file.get(), trace.level);
+    }
+#endif
+
+    const char *mem_params[MAX_CHANNELS] = {setup.mem_params, setup.instr_mem_params};
+    num_chans = setup.instr_mem_params ? 2 : 1;
+    for (unsigned c = 0; c < num_chans and replay_path == nullptr; c++)
+    {
+        chans[c].params = SimbricksParametersParse(mem_params[c]);
+        if (not chans[c].params)
+        {
+            fprintf(stderr, "Failed to parse %s parameters\n", chans[c].name);
+            return EXIT_FAILURE;
+        }
+    }
+    auto free_params = [] {
+        for (unsigned c = 0; c < num_chans; c++)
+        {
+            if (chans[c].params)
+                SimbricksParametersFree(chans[c].params);
+        }
+    };
+
+    // initialize SimBricks memory protocol, a replay reads the channels from
+    // the log instead
+    if (replay_path != nullptr ? not replay_open(clock_period, setup.start_time) : not MemifInit(chans, num_chans))
     {
 #if IBEX_VERILATOR_DEBUG
         sim_log::LogError("could not init mem interface\n");
 #endif
-        SimbricksParametersFree(memAdapterParams);
+        free_params();
+        return EXIT_FAILURE;
+    }
+    if (record_path != nullptr and not record_open(clock_period, setup.start_time))
+    {
+        free_params();
         return EXIT_FAILURE;
     }
 
+    if (icache.size != 0)
+    {
+        mem_channel &ch = port_chan(PORT_INSTR);
+        uint32_t max_line = ch.memif.base.params.in_entries_size - sizeof(struct SimbricksProtoMemM2HReadcomp);
+        if (not cache_init(icache, "icache", max_line))
+        {
+            free_params();
+            return EXIT_FAILURE;
+        }
+    }
+    if (dcache.size != 0)
+    {
+        mem_channel &ch = port_chan(PORT_DATA);
+        uint32_t max_line = ch.memif.base.params.in_entries_size - sizeof(struct SimbricksProtoMemM2HReadcomp);
+        if (not cache_init(dcache, "dcache", max_line))
+        {
+            free_params();
+            return EXIT_FAILURE;
+        }
+    }
+    if (wcb.size != 0)
+    {
+        mem_channel &ch = port_chan(PORT_DATA);
+        if (not wcb_init(ch.memif.base.params.out_entries_size - sizeof(struct SimbricksProtoMemH2MWrite)))
+        {
+            free_params();
+            return EXIT_FAILURE;
+        }
+    }
+
     // initialize and reset the dut
     delayed delay;
     init_dut(*dut, delay);
+#if IBEX_SAVABLE
+    if (setup.restore_path != nullptr and not ckpt_restore(setup.restore_path, *dut, delay))
+    {
+        free_params();
+        return EXIT_FAILURE;
+    }
+#endif
 
+    stats.wall_start = std::chrono::steady_clock::now();
+    stats.start_cycle = stats.last_cycle = cur_cycle;
+    if (stats.file)
+        stats.next_cycle = cur_cycle + stats.interval;
+    prof_start();
+    hang_start();
+    if (num_cores > 1)
+        core_next_barrier = cur_cycle + core_quantum;
     while (not exiting)
     {
-        while (SimbricksMemIfH2MOutSync(&memif, main_time) != 0)
+        if (halted)
+        {
+            core_halt_idle(clock_period);
+            continue;
+        }
+        if (cur_cycle >= core_next_barrier)
+            core_barrier_poll();
+        if (stats_request != stats.request_seen or cur_cycle >= stats.next_cycle)
+            stats_poll();
+#if IBEX_SAVABLE
+        if (main_time >= ckpt.at or ckpt_request)
+            ckpt_poll(*dut, delay);
+#endif
+        if (cur_cycle >= prof.next_sample)
+            prof_sample(*dut);
+        if (cur_cycle >= ff.next_check)
+            ff_poll(*dut);
+        if (cur_cycle >= hang.next_check)
+            hang_check(*dut);
+        if (ff.mode == FF_ISS)
         {
-            sim_log::LogError("warn: SimbricksMemIfH2MOutSync failed (t=%lu)\n", main_time);
+            // up to the next barrier, statistics line, profile sample or hang check
+            ff_run(*dut, clock_period,
+                   std::min({core_next_barrier, stats.next_cycle, prof.next_sample, hang.next_check}));
+            continue;
+        }
+        if (wfi_skip and wfi_idle(*dut))
+        {
+            wfi_fast_forward(clock_period);
         }
 
-        send_core_to_mem(memif, main_time, *dut, delay);
-        do
+        for (unsigned c = 0; c < num_chans; c++)
+        {
+            if (chans[c].sync and main_time >= chans[c].next_sync)
+                chan_sync(chans[c]);
+        }
+        if (ms.active)
+            ms_observe(*dut);
+        if (hang_cfg.cycles != 0)
+            hang_observe(*dut);
+        send_core_to_mem(main_time, *dut, delay);
+        for (unsigned c = 0; c < num_chans; c++)
         {
-            poll_mem_to_core(memif, main_time, *dut, delay);
-        } while (not exiting and (memAdapterParams->sync and
-                                  SimbricksMemIfM2HInTimestamp(&memif) <= main_time));
+            if (main_time >= chans[c].next_poll)
+                chan_drain(chans[c]);
+        }
+        txn_deliver(delay);
+#if VM_TRACE
+        if (trace.file and (trace.check or trace_toggle))
+            trace_update(*dut);
+#endif
 
         /* evaluate on raising edge */
         dut->clk_i = 1;
         dut->eval();
-#if IBEX_VERILATOR_TRACE
-        trace->dump(main_time);
+#if VM_TRACE
+        if (trace.active)
+            trace.file->dump(main_time);
+#endif
+#if IBEX_RVFI
+        if (dut->rvfi_valid)
+        {
+            if (rvfi.active)
+                rvfi_record(*dut);
+            if (prof.active)
+                prof_retire(*dut);
+            // a fence orders the buffered stores before later accesses
+            if (wcb.len != 0 and (dut->rvfi_insn & 0x7f) == 0x0f)
+                wcb.flush = true;
+        }
 #endif
         CheckAlerts(*dut);
         main_time += clock_period / 2;
 
         dut->instr_rvalid_i = delay.instr_rvalid_i;
         dut->instr_rdata_i = delay.instr_rdata_i;
-        dut->instr_gnt_i = !pending_instr_req;
+        dut->instr_gnt_i = txn_port_ready(PORT_INSTR);
         dut->data_rvalid_i = delay.data_rvalid_i;
         dut->data_rdata_i = delay.data_rdata_i;
-        dut->data_gnt_i = !pending_data;
+        dut->data_gnt_i = txn_port_ready(PORT_DATA);
+        dut->irq_timer_i = timer_irq();
 
         // falling edge
         dut->clk_i = 0;
         dut->eval();
 
-#if IBEX_VERILATOR_TRACE
-        trace->dump(main_time);
+#if VM_TRACE
+        if (trace.active)
+            trace.file->dump(main_time);
 #endif
         CheckAlerts(*dut);
         main_time += clock_period / 2;
+        cur_cycle++;
     }
 
-#if IBEX_VERILATOR_TRACE
-    trace->dump(main_time + 1);
-    trace->close();
+#if VM_TRACE
+    if (trace.file and trace.file->isOpen())
+    {
+        if (trace.active)
+            trace.file->dump(main_time + 1);
+        trace.file->close();
+    }
 #endif
 
+    // stores still in the write-combining buffer
+    if (wcb.len != 0)
+        wcb_drain(main_time);
+    console_close();
+    rvfi_close();
+    replay_close();
+
+    std::lock_guard<std::mutex> lock(report_lock);
+    report_header();
+    pcount_report();
     dut->final();
 
-    SimbricksParametersFree(memAdapterParams);
+    stats_print();
+    if (stats.file)
+    {
+        stats_write_json();
+        fclose(stats.file);
+    }
+    txn_print_stats();
+    if (wfi_skip)
+        fprintf(stderr, "wfi: skips=%lu skipped_cycles=%lu\n", wfi_skips, wfi_skipped_cycles);
+    if (icache.size != 0)
+        cache_print_stats(icache, "icache");
+    if (dcache.size != 0)
+        cache_print_stats(dcache, "dcache");
+    if (wcb.size != 0)
+        wcb_print_stats();
+    mmio_print_stats();
+    if (ff_cfg.enabled())
+        ff_print_stats();
+    if (rvfi_path != nullptr)
+        rvfi_print_stats();
+    if (prof.active)
+        prof_write();
+    if (ms.active)
+        ms_write();
+    if (replay_path != nullptr)
+        fprintf(stderr, "replay: messages=%lu diverged=%d\n", replay_msgs, replay_diverged);
+    if (hang.reason != HANG_NONE)
+        hang_print();
+
+    free_params();
+
+    return replay_diverged ? EXIT_FAILURE : hang_exit_status();
+}
+
+int main(int argc, char *argv[])
+{
+    signal(SIGINT, sigint_handler);
+    signal(SIGUSR1, sigusr1_handler);
+
+#if IBEX_VERILATOR_DEBUG
+    sim_log::LogRegistry().SetFlush(true);
+#endif
+
+    // argument parsing and initialization
+    uint64_t clock_period = 4 * 1000ULL; // 4ns -> 250MHz
+    const char *restore_path = nullptr;
+    std::vector<const char *> core_mem_params;
+    std::vector<const char *> instr_mem_params;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case OPT_ICACHE_SIZE:
+            icache.size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_ICACHE_LINE:
+            icache.line_size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_ICACHE_HIT_LATENCY:
+            icache.hit_latency = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_DCACHE_SIZE:
+            dcache.size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_DCACHE_LINE:
+            dcache.line_size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_DCACHE_HIT_LATENCY:
+            dcache.hit_latency = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_CACHEABLE:
+            if (not cacheable_parse(optarg))
+                return EXIT_FAILURE;
+            break;
+        case OPT_WCB_SIZE:
+            wcb.size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_WCB_TIMEOUT:
+            wcb.timeout = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_LOCAL_MEM:
+            local_mem_specs.push_back(optarg);
+            break;
+        case OPT_LOCAL_ELF:
+            local_elf = optarg;
+            break;
+        case OPT_LOCAL_MEM_LATENCY:
+            local_mem_latency = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_NO_WFI_SKIP:
+            wfi_skip = false;
+            break;
+        case OPT_TIMER_BASE:
+            timer.base = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_NO_TIMER:
+            timer.enabled = false;
+            break;
+        case OPT_TRACE:
+            trace.path = optarg;
+            break;
+        case OPT_TRACE_LEVEL:
+            trace.level = strtol(optarg, NULL, 0);
+            break;
+        case OPT_TRACE_START:
+            trace.start = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_TRACE_STOP:
+            trace.stop = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_TRACE_PC:
+            trace.pc_trigger = true;
+            trace.pc = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_TRACE_ADDR:
+            trace.addr_trigger = true;
+            trace.addr = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_STATS_FILE:
+            stats_path = optarg;
+            break;
+        case OPT_STATS_INTERVAL:
+            stats.interval = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_PCOUNT_FILE:
+            pcount_file = optarg;
+            break;
+        case OPT_CHECKPOINT:
+            ckpt.path = optarg;
+            break;
+        case OPT_CHECKPOINT_AT:
+            ckpt.at = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_CHECKPOINT_EXIT:
+            ckpt.exit = true;
+            break;
+        case OPT_RESTORE:
+            restore_path = optarg;
+            break;
+        case OPT_NO_CHAN_BATCH:
+            chan_batch = false;
+            break;
+        case OPT_RECORD:
+            record_path = optarg;
+            break;
+        case OPT_REPLAY:
+            replay_path = optarg;
+            break;
+        case OPT_HANG_CYCLES:
+            hang_cfg.cycles = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_HANG_SPAN:
+            hang_cfg.span = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_HANG_IDLE:
+            if (not hang_parse_idle(optarg))
+                return EXIT_FAILURE;
+            break;
+        case OPT_SIM_LIMIT:
+            hang_cfg.sim_limit = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_WALL_LIMIT:
+            hang_cfg.wall_limit = strtod(optarg, NULL);
+            break;
+        case OPT_INSTR_MEM:
+            instr_mem_params.push_back(optarg);
+            break;
+        case OPT_CORE_MEM:
+            core_mem_params.push_back(optarg);
+            break;
+        case OPT_CORE_QUANTUM:
+            core_quantum = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_SIM_CTRL_BASE:
+            sim_ctrl.base = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_CONSOLE:
+            sim_ctrl.console_path = optarg;
+            break;
+        case OPT_FF_INSNS:
+            ff_cfg.insns = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_FF_UNTIL_PC:
+            ff_cfg.until_pc_set = true;
+            ff_cfg.until_pc = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_FF_UNTIL:
+            ff_cfg.until_time = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_FF_WINDOW:
+            ff_cfg.window = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_FF_PERIOD:
+            ff_cfg.period = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_FF_DM_ADDR:
+            ff_cfg.dm_addr = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_RVFI_TRACE:
+            rvfi_path = optarg;
+            break;
+        case OPT_PROFILE:
+            prof_cfg.path = optarg;
+            break;
+        case OPT_PROFILE_INTERVAL:
+            prof_cfg.interval = strtoull(optarg, NULL, 0);
+            break;
+        case OPT_PROFILE_ELF:
+            prof_cfg.elf = optarg;
+            break;
+        case OPT_MEM_STATS:
+            ms_cfg.path = optarg;
+            break;
+        case OPT_MEM_STATS_ELF:
+            ms_cfg.elf = optarg;
+            break;
+        case OPT_MEM_STATS_LINE:
+            ms_cfg.line_size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_MEM_STATS_PAGE:
+            ms_cfg.page_size = strtoul(optarg, NULL, 0);
+            break;
+        case OPT_MEM_STATS_STACK:
+            if (not ms_parse_stack(optarg))
+                return EXIT_FAILURE;
+            break;
+        case OPT_PROFILE_FORMAT:
+            if (strcmp(optarg, "folded") == 0)
+                prof_cfg.folded = true;
+            else if (strcmp(optarg, "flat") != 0)
+            {
+                fprintf(stderr, "unknown profile format %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        default:
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    trace.check = trace.path or trace.start != 0 or trace.stop != UINT64_MAX or trace.pc_trigger or
+                  trace.addr_trigger;
+#if VM_TRACE
+    signal(SIGUSR2, sigusr2_handler);
+#else
+    if (trace.check)
+    {
+        fprintf(stderr, "tracing is not compiled into this binary\n");
+        return EXIT_FAILURE;
+    }
+#endif
+#if !IBEX_RVFI
+    if (rvfi_path != nullptr)
+    {
+        fprintf(stderr, "--rvfi-trace needs a model built with +define+RVFI\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    if (local_mem_latency == 0)
+    {
+        fprintf(stderr, "local-mem: latency must be at least one cycle\n");
+        return EXIT_FAILURE;
+    }
+    num_cores = 1 + core_mem_params.size();
+    if (not instr_mem_params.empty() and instr_mem_params.size() != num_cores)
+    {
+        fprintf(stderr, "--instr-mem has to be given once per core or not at all\n");
+        return EXIT_FAILURE;
+    }
+    if (num_cores > 1 and (ckpt.path != nullptr or restore_path != nullptr))
+    {
+        fprintf(stderr, "checkpoints are only supported with a single core\n");
+        return EXIT_FAILURE;
+    }
+    if (ff_cfg.enabled() and (ckpt.path != nullptr or restore_path != nullptr))
+    {
+        fprintf(stderr, "checkpoints cannot be combined with fast-forwarding\n");
+        return EXIT_FAILURE;
+    }
+    if ((dcache.size != 0 or wcb.size != 0) and cacheable_ranges.empty())
+    {
+        fprintf(stderr, "--dcache-size and --wcb-size need at least one --cacheable range\n");
+        return EXIT_FAILURE;
+    }
+    if (wcb.size != 0 and ff_cfg.enabled())
+    {
+        fprintf(stderr, "write combining cannot be combined with fast-forwarding\n");
+        return EXIT_FAILURE;
+    }
+    if (wcb.timeout == 0)
+    {
+        fprintf(stderr, "wcb: timeout must be at least one cycle\n");
+        return EXIT_FAILURE;
+    }
+    if ((ff_cfg.window != 0) != (ff_cfg.period != 0))
+    {
+        fprintf(stderr, "--ff-window and --ff-period are only used together\n");
+        return EXIT_FAILURE;
+    }
+    if (ff_cfg.dm_addr % 4 != 0)
+    {
+        fprintf(stderr, "--ff-dm-addr has to be word aligned\n");
+        return EXIT_FAILURE;
+    }
+#if IBEX_SAVABLE
+    if (ckpt.path != nullptr)
+    {
+        signal(SIGHUP, sighup_handler);
+    }
+    else if (ckpt.at != UINT64_MAX or ckpt.exit)
+    {
+        fprintf(stderr, "--checkpoint-at and --checkpoint-exit need --checkpoint\n");
+        return EXIT_FAILURE;
+    }
+#else
+    if (ckpt.path != nullptr or restore_path != nullptr)
+    {
+        fprintf(stderr, "checkpoints need a model built with --savable\n");
+        return EXIT_FAILURE;
+    }
+#endif
+    if (stats_path != nullptr and stats.interval == 0)
+    {
+        fprintf(stderr, "stats interval must be at least one cycle\n");
+        return EXIT_FAILURE;
+    }
+    if (record_path != nullptr and replay_path != nullptr)
+    {
+        fprintf(stderr, "--record and --replay exclude each other\n");
+        return EXIT_FAILURE;
+    }
+    if (hang_cfg.span == 0)
+    {
+        fprintf(stderr, "hang: span must be at least one byte\n");
+        return EXIT_FAILURE;
+    }
+    if (prof_cfg.interval == 0)
+    {
+        fprintf(stderr, "profile interval must be at least one cycle\n");
+        return EXIT_FAILURE;
+    }
+    auto pow2 = [](uint32_t x) { return x != 0 and (x & (x - 1)) == 0; };
+    if (not pow2(ms_cfg.line_size) or not pow2(ms_cfg.page_size) or ms_cfg.line_size < 4 or
+        ms_cfg.line_size > ms_cfg.page_size)
+    {
+        fprintf(stderr, "mem-stats: line and page size must be powers of two, 4 <= line <= page\n");
+        return EXIT_FAILURE;
+    }
+    // plusargs are Verilator runtime options, everything else is positional
+    std::vector<const char *> args;
+    for (int i = optind; i < argc; i++)
+    {
+        if (argv[i][0] != '+')
+            args.push_back(argv[i]);
+    }
+    if (args.size() < 1 or args.size() > 3)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    uint64_t start_time = 0;
+    if (args.size() >= 2)
+    {
+        start_time = strtoull(args[1], NULL, 0);
+    }
+    if (args.size() == 3)
+    {
+        clock_period = 1000000ULL / strtoull(args[2], NULL, 0);
+    }
+
+    std::vector<core_setup> setups;
+    for (unsigned i = 0; i < num_cores; i++)
+    {
+        setups.push_back({i == 0 ? args[0] : core_mem_params[i - 1],
+                          instr_mem_params.empty() ? nullptr : instr_mem_params[i], start_time, clock_period,
+                          restore_path, argc, argv});
+    }
+    if (num_cores == 1)
+        return core_run(setups[0]);
+
+    // by default the cores meet once per sync interval of the first channel
+    if (core_quantum == 0)
+    {
+        // a replay does not use the parameters, the quantum only paces the cores
+        struct SimbricksAdapterParams *params = replay_path ? nullptr : SimbricksParametersParse(args[0]);
+        if (not params and replay_path == nullptr)
+        {
+            fprintf(stderr, "Failed to parse mem parameters\n");
+            return EXIT_FAILURE;
+        }
+        struct SimbricksBaseIfParams defaults;
+        SimbricksMemIfDefaultParams(&defaults);
+        uint64_t interval = params and params->sync_interval_set ? params->sync_interval * 1000ULL
+                                                                 : defaults.sync_interval;
+        core_quantum = std::max<uint64_t>(1, interval / clock_period);
+        if (params)
+            SimbricksParametersFree(params);
+    }
+
+    // the other cores start from the configuration parsed into this thread
+    std::vector<std::thread> threads;
+    std::vector<int> results(num_cores, EXIT_SUCCESS);
+    for (unsigned i = 1; i < num_cores; i++)
+    {
+        threads.emplace_back([&setups, &results, i, icache_config = icache, dcache_config = dcache,
+                              wcb_config = wcb, timer_config = timer, sim_ctrl_base = sim_ctrl.base,
+                              console_path = sim_ctrl.console_path, stats_interval = stats.interval] {
+            core_id = i;
+            icache = icache_config;
+            dcache = dcache_config;
+            wcb = wcb_config;
+            timer = timer_config;
+            sim_ctrl.base = sim_ctrl_base;
+            sim_ctrl.console_path = console_path;
+            stats.interval = stats_interval;
+            results[i] = core_run(setups[i]);
+            if (results[i] != EXIT_SUCCESS)
+                exiting = true;
+        });
+    }
+    results[0] = core_run(setups[0]);
+    if (results[0] != EXIT_SUCCESS)
+        exiting = true;
+    for (std::thread &t : threads)
+        t.join();
 
+    for (int result : results)
+    {
+        if (result != EXIT_SUCCESS)
+            return result;
+    }
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,656 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "rv32_iss.h"
+
+// misa of the default Ibex configuration: MXL=32, C, I, M
+#define RV32_MISA 0x40001104U
+#define RV32_MARCHID 22U // Ibex
+
+#define CAUSE_INSN_FAULT 1
+#define CAUSE_ILLEGAL 2
+#define CAUSE_BREAKPOINT 3
+#define CAUSE_LOAD_FAULT 5
+#define CAUSE_STORE_FAULT 7
+#define CAUSE_ECALL_M 11
+#define CAUSE_IRQ 0x80000000U
+
+static inline uint32_t bits(uint32_t v, int hi, int lo)
+{
+    return (v >> lo) & ((1U << (hi - lo + 1)) - 1);
+}
+
+static inline int32_t sext(uint32_t v, int width)
+{
+    return int32_t(v << (32 - width)) >> (32 - width);
+}
+
+// the equivalent 32-bit instruction of a compressed one, 0 if it is illegal
+static uint32_t expand_compressed(uint32_t c)
+{
+    uint32_t f3 = bits(c, 15, 13);
+    uint32_t rd = bits(c, 11, 7);
+    uint32_t rs2 = bits(c, 6, 2);
+    uint32_t rdp = bits(c, 4, 2) + 8;
+    uint32_t rs1p = bits(c, 9, 7) + 8;
+    uint32_t mem_off = bits(c, 12, 10) << 3 | bits(c, 6, 6) << 2 | bits(c, 5, 5) << 6;
+
+    switch (bits(c, 1, 0) << 3 | f3)
+    {
+    case 000: // c.addi4spn
+    {
+        uint32_t imm = bits(c, 12, 11) << 4 | bits(c, 10, 7) << 6 | bits(c, 6, 6) << 2 | bits(c, 5, 5) << 3;
+        return imm ? rv32_addi(rdp, 2, imm) : 0;
+    }
+    case 002: // c.lw
+        return rv32_lw(rdp, mem_off, rs1p);
+    case 006: // c.sw
+        return rv32_sw(rdp, mem_off, rs1p);
+    case 010: // c.addi
+        return rv32_addi(rd, rd, sext(bits(c, 12, 12) << 5 | rs2, 6));
+    case 011: // c.jal
+    case 015: // c.j
+    {
+        int32_t imm = sext(bits(c, 12, 12) << 11 | bits(c, 11, 11) << 4 | bits(c, 10, 9) << 8 | bits(c, 8, 8) << 10 |
+                               bits(c, 7, 7) << 6 | bits(c, 6, 6) << 7 | bits(c, 5, 3) << 1 | bits(c, 2, 2) << 5,
+                           12);
+        return rv32_jal(f3 == 1 ? 1 : 0, imm);
+    }
+    case 012: // c.li
+        return rv32_addi(rd, 0, sext(bits(c, 12, 12) << 5 | rs2, 6));
+    case 013:
+    {
+        if (rd == 2) // c.addi16sp
+        {
+            int32_t imm = sext(bits(c, 12, 12) << 9 | bits(c, 6, 6) << 4 | bits(c, 5, 5) << 6 | bits(c, 4, 3) << 7 |
+                                   bits(c, 2, 2) << 5,
+                               10);
+            return imm ? rv32_addi(2, 2, imm) : 0;
+        }
+        int32_t imm = sext(bits(c, 12, 12) << 17 | rs2 << 12, 18); // c.lui
+        return imm ? rv32_lui(rd, imm) : 0;
+    }
+    case 014:
+        switch (bits(c, 11, 10))
+        {
+        case 0: // c.srli
+            return bits(c, 12, 12) ? 0 : rv32_enc_r(0x00, rs2, rs1p, 5, rs1p, 0x13);
+        case 1: // c.srai
+            return bits(c, 12, 12) ? 0 : rv32_enc_r(0x20, rs2, rs1p, 5, rs1p, 0x13);
+        case 2: // c.andi
+            return rv32_enc_i(sext(bits(c, 12, 12) << 5 | rs2, 6), rs1p, 7, rs1p, 0x13);
+        default:
+        {
+            // c.sub, c.xor, c.or, c.and
+            static const uint32_t funct3[4] = {0, 4, 6, 7};
+            if (bits(c, 12, 12))
+                return 0;
+            uint32_t f = bits(c, 6, 5);
+            return rv32_enc_r(f == 0 ? 0x20 : 0x00, rdp, rs1p, funct3[f], rs1p, 0x33);
+        }
+        }
+    case 016: // c.beqz
+    case 017: // c.bnez
+    {
+        int32_t imm = sext(bits(c, 12, 12) << 8 | bits(c, 11, 10) << 3 | bits(c, 6, 5) << 6 | bits(c, 4, 3) << 1 |
+                               bits(c, 2, 2) << 5,
+                           9);
+        return f3 == 6 ? rv32_beq(rs1p, 0, imm) : rv32_bne(rs1p, 0, imm);
+    }
+    case 020: // c.slli
+        return bits(c, 12, 12) ? 0 : rv32_enc_r(0x00, rs2, rd, 1, rd, 0x13);
+    case 022: // c.lwsp
+    {
+        uint32_t imm = bits(c, 12, 12) << 5 | bits(c, 6, 4) << 2 | bits(c, 3, 2) << 6;
+        return rd ? rv32_lw(rd, imm, 2) : 0;
+    }
+    case 024:
+        if (not bits(c, 12, 12))
+        {
+            if (rs2 == 0) // c.jr
+                return rd ? rv32_enc_i(0, rd, 0, 0, 0x67) : 0;
+            return rv32_enc_r(0, rs2, 0, 0, rd, 0x33); // c.mv
+        }
+        if (rs2 == 0) // c.ebreak, c.jalr
+            return rd ? rv32_enc_i(0, rd, 0, 1, 0x67) : 0x00100073;
+        return rv32_enc_r(0, rs2, rd, 0, rd, 0x33); // c.add
+    case 026: // c.swsp
+        return rv32_sw(rs2, bits(c, 12, 9) << 2 | bits(c, 8, 7) << 6, 2);
+    default:
+        return 0;
+    }
+}
+
+static void trap(rv32_state &s, uint32_t cause, uint32_t tval)
+{
+    s.mepc = s.pc;
+    s.mcause = cause;
+    s.mtval = tval;
+    uint32_t mpie = (s.mstatus & RV32_MSTATUS_MIE) ? RV32_MSTATUS_MPIE : 0;
+    s.mstatus = (s.mstatus & ~(RV32_MSTATUS_MIE | RV32_MSTATUS_MPIE)) | mpie | RV32_MSTATUS_MPP;
+    s.pc = s.mtvec & ~3U;
+    // Ibex only supports vectored mode
+    if ((cause & CAUSE_IRQ) and (s.mtvec & 1))
+        s.pc += 4 * (cause & 0x1f);
+}
+
+static void retire(rv32_state &s, uint32_t next)
+{
+    s.pc = next;
+    if (not (s.mcountinhibit & 4))
+        s.minstret++;
+}
+
+// the highest priority pending and enabled interrupt, Ibex order
+static int irq_pending(const rv32_state &s)
+{
+    uint32_t pending = s.mip & s.mie;
+    if (pending == 0)
+        return -1;
+    for (int i = RV32_IRQ_FAST_SHIFT; i < 31; i++)
+    {
+        if (pending & (1U << i))
+            return i;
+    }
+    if (pending & RV32_IRQ_EXTERNAL)
+        return 11;
+    if (pending & RV32_IRQ_SOFTWARE)
+        return 3;
+    if (pending & RV32_IRQ_TIMER)
+        return 7;
+    return -1;
+}
+
+bool rv32_csr_read(const rv32_state &s, uint32_t csr, uint32_t &val)
+{
+    switch (csr)
+    {
+    case RV32_CSR_MSTATUS:
+        val = s.mstatus;
+        return true;
+    case RV32_CSR_MISA:
+        val = RV32_MISA;
+        return true;
+    case RV32_CSR_MIE:
+        val = s.mie;
+        return true;
+    case RV32_CSR_MTVEC:
+        val = s.mtvec;
+        return true;
+    case RV32_CSR_MSCRATCH:
+        val = s.mscratch;
+        return true;
+    case RV32_CSR_MEPC:
+        val = s.mepc;
+        return true;
+    case RV32_CSR_MCAUSE:
+        val = s.mcause;
+        return true;
+    case RV32_CSR_MTVAL:
+        val = s.mtval;
+        return true;
+    case RV32_CSR_MIP:
+        val = s.mip;
+        return true;
+    case RV32_CSR_MCYCLE:
+    case 0xc00: // cycle
+        val = s.mcycle;
+        return true;
+    case RV32_CSR_MCYCLEH:
+    case 0xc80: // cycleh
+        val = s.mcycle >> 32;
+        return true;
+    case RV32_CSR_MINSTRET:
+    case 0xc02: // instret
+        val = s.minstret;
+        return true;
+    case RV32_CSR_MINSTRETH:
+    case 0xc82: // instreth
+        val = s.minstret >> 32;
+        return true;
+    case RV32_CSR_MHARTID:
+        val = s.mhartid;
+        return true;
+    case 0xf12: // marchid
+        val = RV32_MARCHID;
+        return true;
+    case RV32_CSR_MCOUNTINHIBIT:
+        val = s.mcountinhibit;
+        return true;
+    case 0xf11: // mvendorid
+    case 0xf13: // mimpid
+        val = 0;
+        return true;
+    }
+    // the event counters are not modelled
+    if ((csr >= 0xb03 and csr <= 0xb1f) or (csr >= 0xb83 and csr <= 0xb9f) or (csr >= 0x323 and csr <= 0x33f))
+    {
+        val = 0;
+        return true;
+    }
+    return false;
+}
+
+void rv32_csr_write(rv32_state &s, uint32_t csr, uint32_t val)
+{
+    switch (csr)
+    {
+    case RV32_CSR_MSTATUS:
+        s.mstatus = val & (RV32_MSTATUS_MIE | RV32_MSTATUS_MPIE | RV32_MSTATUS_MPP);
+        break;
+    case RV32_CSR_MIE:
+        s.mie = val & (RV32_IRQ_SOFTWARE | RV32_IRQ_TIMER | RV32_IRQ_EXTERNAL | 0x7fffU << RV32_IRQ_FAST_SHIFT);
+        break;
+    case RV32_CSR_MTVEC:
+        s.mtvec = (val & ~0xffU) | 1;
+        break;
+    case RV32_CSR_MSCRATCH:
+        s.mscratch = val;
+        break;
+    case RV32_CSR_MEPC:
+        s.mepc = val & ~1U;
+        break;
+    case RV32_CSR_MCAUSE:
+        s.mcause = val;
+        break;
+    case RV32_CSR_MTVAL:
+        s.mtval = val;
+        break;
+    case RV32_CSR_MCYCLE:
+        s.mcycle = (s.mcycle & ~0xffffffffULL) | val;
+        break;
+    case RV32_CSR_MCYCLEH:
+        s.mcycle = (s.mcycle & 0xffffffffULL) | uint64_t(val) << 32;
+        break;
+    case RV32_CSR_MINSTRET:
+        s.minstret = (s.minstret & ~0xffffffffULL) | val;
+        break;
+    case RV32_CSR_MINSTRETH:
+        s.minstret = (s.minstret & 0xffffffffULL) | uint64_t(val) << 32;
+        break;
+    case RV32_CSR_MCOUNTINHIBIT:
+        // there is no time counter to inhibit
+        s.mcountinhibit = val & ~2U;
+        break;
+    }
+}
+
+// splits accesses that cross a word boundary
+static rv32_mem load(const rv32_bus &bus, uint32_t addr, unsigned size, uint32_t &val)
+{
+    uint32_t off = addr & 3;
+    uint32_t word = addr & ~3U;
+    uint32_t lo, hi = 0;
+    rv32_mem r = bus.load(word, ((1U << size) - 1) << off & 0xf, lo);
+    if (r != RV32_MEM_OK)
+        return r;
+    if (off + size > 4)
+    {
+        r = bus.load(word + 4, (1U << (off + size - 4)) - 1, hi);
+        if (r != RV32_MEM_OK)
+            return r;
+    }
+    val = (uint64_t(hi) << 32 | lo) >> (8 * off);
+    return RV32_MEM_OK;
+}
+
+static rv32_mem store(const rv32_bus &bus, uint32_t addr, unsigned size, uint32_t val)
+{
+    uint32_t off = addr & 3;
+    uint32_t word = addr & ~3U;
+    uint64_t data = uint64_t(val) << (8 * off);
+    rv32_mem r = bus.store(word, ((1U << size) - 1) << off & 0xf, data);
+    if (r != RV32_MEM_OK or off + size <= 4)
+        return r;
+    return bus.store(word + 4, (1U << (off + size - 4)) - 1, data >> 32);
+}
+
+static uint32_t alu_m(uint32_t f3, uint32_t a, uint32_t b)
+{
+    int32_t sa = a, sb = b;
+    switch (f3)
+    {
+    case 0: // mul
+        return a * b;
+    case 1: // mulh
+        return (int64_t(sa) * int64_t(sb)) >> 32;
+    case 2: // mulhsu
+        return (int64_t(sa) * int64_t(uint64_t(b))) >> 32;
+    case 3: // mulhu
+        return (uint64_t(a) * uint64_t(b)) >> 32;
+    case 4: // div
+        if (b == 0)
+            return UINT32_MAX;
+        if (sa == INT32_MIN and sb == -1)
+            return a;
+        return sa / sb;
+    case 5: // divu
+        return b == 0 ? UINT32_MAX : a / b;
+    case 6: // rem
+        if (b == 0)
+            return a;
+        if (sa == INT32_MIN and sb == -1)
+            return 0;
+        return sa % sb;
+    default: // remu
+        return b == 0 ? a : a % b;
+    }
+}
+
+rv32_step_result rv32_step(rv32_state &s, const rv32_bus &bus)
+{
+    int irq = irq_pending(s);
+    if (irq >= 0 and (s.mstatus & RV32_MSTATUS_MIE))
+    {
+        trap(s, CAUSE_IRQ | irq, 0);
+        return RV32_TRAPPED;
+    }
+
+    // fetch, a 32-bit instruction may continue in the next word
+    uint32_t word, insn;
+    rv32_mem r = bus.fetch(s.pc & ~3U, word);
+    if (r == RV32_MEM_RETRY)
+        return RV32_RETRY;
+    if (r == RV32_MEM_FAULT)
+    {
+        trap(s, CAUSE_INSN_FAULT, s.pc);
+        return RV32_TRAPPED;
+    }
+    insn = (s.pc & 2) ? word >> 16 : word;
+    if ((insn & 3) == 3 and (s.pc & 2))
+    {
+        r = bus.fetch((s.pc & ~3U) + 4, word);
+        if (r == RV32_MEM_RETRY)
+            return RV32_RETRY;
+        if (r == RV32_MEM_FAULT)
+        {
+            trap(s, CAUSE_INSN_FAULT, s.pc);
+            return RV32_TRAPPED;
+        }
+        insn = (insn & 0xffff) | word << 16;
+    }
+    uint32_t next = s.pc + 4;
+    if ((insn & 3) != 3)
+    {
+        uint32_t c = insn & 0xffff;
+        insn = expand_compressed(c);
+        if (insn == 0)
+        {
+            trap(s, CAUSE_ILLEGAL, c);
+            return RV32_TRAPPED;
+        }
+        next = s.pc + 2;
+    }
+
+    uint32_t op = insn & 0x7f;
+    uint32_t rd = bits(insn, 11, 7);
+    uint32_t f3 = bits(insn, 14, 12);
+    uint32_t rs1 = bits(insn, 19, 15);
+    uint32_t rs2 = bits(insn, 24, 20);
+    uint32_t f7 = insn >> 25;
+    uint32_t a = s.x[rs1];
+    uint32_t b = s.x[rs2];
+    int32_t imm_i = int32_t(insn) >> 20;
+    int32_t imm_s = int32_t(insn & 0xfe000000) >> 20 | int32_t(rd);
+    uint32_t res = 0;
+    bool write_rd = true;
+    bool illegal = false;
+
+    switch (op)
+    {
+    case 0x37: // lui
+        res = insn & 0xfffff000;
+        break;
+    case 0x17: // auipc
+        res = s.pc + (insn & 0xfffff000);
+        break;
+    case 0x6f: // jal
+        res = next;
+        next = s.pc + sext(bits(insn, 31, 31) << 20 | bits(insn, 19, 12) << 12 | bits(insn, 20, 20) << 11 |
+                               bits(insn, 30, 21) << 1,
+                           21);
+        break;
+    case 0x67: // jalr
+        illegal = f3 != 0;
+        res = next;
+        next = (a + imm_i) & ~1U;
+        break;
+    case 0x63: // branches
+    {
+        bool taken;
+        switch (f3)
+        {
+        case 0:
+            taken = a == b;
+            break;
+        case 1:
+            taken = a != b;
+            break;
+        case 4:
+            taken = int32_t(a) < int32_t(b);
+            break;
+        case 5:
+            taken = int32_t(a) >= int32_t(b);
+            break;
+        case 6:
+            taken = a < b;
+            break;
+        case 7:
+            taken = a >= b;
+            break;
+        default:
+            taken = false;
+            illegal = true;
+        }
+        if (taken)
+            next = s.pc + sext(bits(insn, 31, 31) << 12 | bits(insn, 7, 7) << 11 | bits(insn, 30, 25) << 5 |
+                                   bits(insn, 11, 8) << 1,
+                               13);
+        write_rd = false;
+        break;
+    }
+    case 0x03: // loads
+    {
+        static const unsigned sizes[8] = {1, 2, 4, 0, 1, 2, 0, 0};
+        unsigned size = sizes[f3];
+        if (size == 0)
+        {
+            illegal = true;
+            break;
+        }
+        uint32_t addr = a + imm_i;
+        r = load(bus, addr, size, res);
+        if (r == RV32_MEM_RETRY)
+            return RV32_RETRY;
+        if (r == RV32_MEM_FAULT)
+        {
+            trap(s, CAUSE_LOAD_FAULT, addr);
+            return RV32_TRAPPED;
+        }
+        if (f3 == 0)
+            res = int8_t(res);
+        else if (f3 == 1)
+            res = int16_t(res);
+        else if (f3 == 4)
+            res &= 0xff;
+        else if (f3 == 5)
+            res &= 0xffff;
+        break;
+    }
+    case 0x23: // stores
+    {
+        if (f3 > 2)
+        {
+            illegal = true;
+            break;
+        }
+        uint32_t addr = a + imm_s;
+        r = store(bus, addr, 1U << f3, b);
+        if (r == RV32_MEM_RETRY)
+            return RV32_RETRY;
+        if (r == RV32_MEM_FAULT)
+        {
+            trap(s, CAUSE_STORE_FAULT, addr);
+            return RV32_TRAPPED;
+        }
+        write_rd = false;
+        break;
+    }
+    case 0x13: // register-immediate
+        switch (f3)
+        {
+        case 0:
+            res = a + imm_i;
+            break;
+        case 1:
+            illegal = f7 != 0;
+            res = a << rs2;
+            break;
+        case 2:
+            res = int32_t(a) < imm_i;
+            break;
+        case 3:
+            res = a < uint32_t(imm_i);
+            break;
+        case 4:
+            res = a ^ imm_i;
+            break;
+        case 5:
+            illegal = f7 != 0 and f7 != 0x20;
+            res = f7 ? uint32_t(int32_t(a) >> rs2) : a >> rs2;
+            break;
+        case 6:
+            res = a | imm_i;
+            break;
+        default:
+            res = a & imm_i;
+        }
+        break;
+    case 0x33: // register-register
+        if (f7 == 1)
+        {
+            res = alu_m(f3, a, b);
+            break;
+        }
+        illegal = f7 != 0 and not(f7 == 0x20 and (f3 == 0 or f3 == 5));
+        switch (f3)
+        {
+        case 0:
+            res = f7 ? a - b : a + b;
+            break;
+        case 1:
+            res = a << (b & 31);
+            break;
+        case 2:
+            res = int32_t(a) < int32_t(b);
+            break;
+        case 3:
+            res = a < b;
+            break;
+        case 4:
+            res = a ^ b;
+            break;
+        case 5:
+            res = f7 ? uint32_t(int32_t(a) >> (b & 31)) : a >> (b & 31);
+            break;
+        case 6:
+            res = a | b;
+            break;
+        default:
+            res = a & b;
+        }
+        break;
+    case 0x0f: // fence, fence.i
+        illegal = f3 > 1;
+        write_rd = false;
+        break;
+    case 0x73:
+    {
+        if (f3 == 0)
+        {
+            write_rd = false;
+            switch (insn)
+            {
+            case 0x00000073: // ecall
+                trap(s, CAUSE_ECALL_M, 0);
+                return RV32_TRAPPED;
+            case 0x00100073: // ebreak
+                trap(s, CAUSE_BREAKPOINT, 0);
+                return RV32_TRAPPED;
+            case 0x30200073: // mret, Ibex returns MPP to U-mode
+                next = s.mepc;
+                s.mstatus = (s.mstatus & ~(RV32_MSTATUS_MIE | RV32_MSTATUS_MPP)) | RV32_MSTATUS_MPIE |
+                            ((s.mstatus & RV32_MSTATUS_MPIE) ? RV32_MSTATUS_MIE : 0);
+                break;
+            case 0x10500073: // wfi, retires and sleeps unless an interrupt is pending
+                if (irq < 0)
+                {
+                    retire(s, next);
+                    return RV32_WFI;
+                }
+                break;
+            default:
+                illegal = true;
+            }
+            break;
+        }
+        uint32_t csr = insn >> 20;
+        uint32_t src = (f3 & 4) ? rs1 : a;
+        // csrrw always writes, csrrs/csrrc only with a non-zero source
+        bool writes = (f3 & 3) == 1 or rs1 != 0;
+        if (f3 == 4 or not rv32_csr_read(s, csr, res) or (writes and bits(csr, 11, 10) == 3))
+        {
+            illegal = true;
+            break;
+        }
+        if (writes)
+        {
+            switch (f3 & 3)
+            {
+            case 1:
+                rv32_csr_write(s, csr, src);
+                break;
+            case 2:
+                rv32_csr_write(s, csr, res | src);
+                break;
+            default:
+                rv32_csr_write(s, csr, res & ~src);
+            }
+        }
+        break;
+    }
+    default:
+        illegal = true;
+    }
+
+    if (illegal)
+    {
+        trap(s, CAUSE_ILLEGAL, insn);
+        return RV32_TRAPPED;
+    }
+    if (write_rd and rd != 0)
+        s.x[rd] = res;
+    retire(s, next);
+    return RV32_RETIRED;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright 2025 Max Planck Institute for Software Systems, and
+ * National University of Singapore
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+/* Functional RV32IMC instruction-set simulator for fast-forwarding the
+ * adapter. It covers the machine-mode subset of Ibex the applications under
+ * app/ use: RV32IMC, Zicsr, the trap CSRs, mcycle/minstret, mret and wfi.
+ * Memory goes through callbacks that can ask for an access to be retried
+ * later. The instruction is then not retired and executes again on the next
+ * step. */
+
+#define RV32_CSR_MSTATUS 0x300
+#define RV32_CSR_MISA 0x301
+#define RV32_CSR_MIE 0x304
+#define RV32_CSR_MTVEC 0x305
+#define RV32_CSR_MCOUNTINHIBIT 0x320
+#define RV32_CSR_MSCRATCH 0x340
+#define RV32_CSR_MEPC 0x341
+#define RV32_CSR_MCAUSE 0x342
+#define RV32_CSR_MTVAL 0x343
+#define RV32_CSR_MIP 0x344
+#define RV32_CSR_DCSR 0x7b0
+#define RV32_CSR_DPC 0x7b1
+#define RV32_CSR_DSCRATCH0 0x7b2
+#define RV32_CSR_DSCRATCH1 0x7b3
+#define RV32_CSR_MCYCLE 0xb00
+#define RV32_CSR_MINSTRET 0xb02
+#define RV32_CSR_MCYCLEH 0xb80
+#define RV32_CSR_MINSTRETH 0xb82
+#define RV32_CSR_MHARTID 0xf14
+
+#define RV32_MSTATUS_MIE (1U << 3)
+#define RV32_MSTATUS_MPIE (1U << 7)
+#define RV32_MSTATUS_MPP (3U << 11)
+
+// interrupt lines in mip/mie
+#define RV32_IRQ_SOFTWARE (1U << 3)
+#define RV32_IRQ_TIMER (1U << 7)
+#define RV32_IRQ_EXTERNAL (1U << 11)
+#define RV32_IRQ_FAST_SHIFT 16
+
+enum rv32_mem {
+    RV32_MEM_OK,
+    RV32_MEM_RETRY, // not available yet, the instruction executes again later
+    RV32_MEM_FAULT, // raises an access fault
+};
+
+// word aligned accesses, be selects the bytes of a load or store
+struct rv32_bus {
+    rv32_mem (*fetch)(uint32_t addr, uint32_t &word);
+    rv32_mem (*load)(uint32_t addr, uint8_t be, uint32_t &word);
+    rv32_mem (*store)(uint32_t addr, uint8_t be, uint32_t word);
+};
+
+struct rv32_state {
+    uint32_t x[32] = {};
+    uint32_t pc = 0;
+    uint32_t mstatus = 0;
+    uint32_t mie = 0;
+    uint32_t mip = 0; // interrupt inputs, set by the caller before each step
+    uint32_t mtvec = 0;
+    uint32_t mscratch = 0;
+    uint32_t mepc = 0;
+    uint32_t mcause = 0;
+    uint32_t mtval = 0;
+    uint64_t mcycle = 0; // advanced by the caller
+    uint64_t minstret = 0;
+    uint32_t mcountinhibit = 0; // bit 0 stops mcycle, bit 2 minstret
+    uint32_t mhartid = 0;
+};
+
+enum rv32_step_result {
+    RV32_RETIRED,
+    RV32_TRAPPED, // exception or interrupt taken, pc is at the handler
+    RV32_RETRY,   // waiting for memory, nothing changed
+    RV32_WFI,     // retired a WFI, sleeping until an enabled interrupt is pending
+};
+
+rv32_step_result rv32_step(rv32_state &s, const rv32_bus &bus);
+
+// CSR access as by the program, returns false for CSRs that do not exist
+bool rv32_csr_read(const rv32_state &s, uint32_t csr, uint32_t &val);
+void rv32_csr_write(rv32_state &s, uint32_t csr, uint32_t val);
+
+/* Instruction encoders, used to expand compressed instructions and to
+ * assemble code at runtime. */
+
+inline uint32_t rv32_enc_r(uint32_t f7, uint32_t rs2, uint32_t rs1, uint32_t f3, uint32_t rd, uint32_t op)
+{
+    return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+inline uint32_t rv32_enc_i(int32_t imm, uint32_t rs1, uint32_t f3, uint32_t rd, uint32_t op)
+{
+    return uint32_t(imm) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+
+inline uint32_t rv32_enc_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3, uint32_t op)
+{
+    uint32_t u = imm;
+    return (u >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (u & 0x1f) << 7 | op;
+}
+
+inline uint32_t rv32_enc_b(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t f3)
+{
+    uint32_t u = imm;
+    return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (u >> 1 & 0xf) << 8 |
+           (u >> 11 & 1) << 7 | 0x63;
+}
+
+inline uint32_t rv32_enc_u(uint32_t imm, uint32_t rd, uint32_t op)
+{
+    return (imm & 0xfffff000) | rd << 7 | op;
+}
+
+inline uint32_t rv32_enc_j(int32_t imm, uint32_t rd)
+{
+    uint32_t u = imm;
+    return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20 | (u >> 12 & 0xff) << 12 | rd << 7 |
+           0x6f;
+}
+
+inline uint32_t rv32_lw(uint32_t rd, int32_t off, uint32_t rs1) { return rv32_enc_i(off, rs1, 2, rd, 0x03); }
+inline uint32_t rv32_sw(uint32_t rs2, int32_t off, uint32_t rs1) { return rv32_enc_s(off, rs2, rs1, 2, 0x23); }
+inline uint32_t rv32_addi(uint32_t rd, uint32_t rs1, int32_t imm) { return rv32_enc_i(imm, rs1, 0, rd, 0x13); }
+inline uint32_t rv32_lui(uint32_t rd, uint32_t imm) { return rv32_enc_u(imm, rd, 0x37); }
+inline uint32_t rv32_csrw(uint32_t csr, uint32_t rs1) { return rv32_enc_i(csr, rs1, 1, 0, 0x73); }
+inline uint32_t rv32_csrr(uint32_t rd, uint32_t csr) { return rv32_enc_i(csr, 0, 2, rd, 0x73); }
+inline uint32_t rv32_beq(uint32_t rs1, uint32_t rs2, int32_t off) { return rv32_enc_b(off, rs2, rs1, 0); }
+inline uint32_t rv32_bne(uint32_t rs1, uint32_t rs2, int32_t off) { return rv32_enc_b(off, rs2, rs1, 1); }
+inline uint32_t rv32_jal(uint32_t rd, int32_t off) { return rv32_enc_j(off, rd); }
+#define RV32_DRET 0x7b200073U
@@ -0,0 +1,114 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Branch heavy code: data dependent conditions on random input, a state
+// machine dispatched through a switch, and binary searches.
+
+#include "bench.h"
+
+// checksum of a correct run, independent of BENCH_ITERATIONS
+#define BENCH_BRANCH_EXPECTED 0x0AE40096
+
+#define DATA_LEN 1024
+#define SEARCHES 1024
+
+static uint32_t data[DATA_LEN];
+static uint32_t sorted[DATA_LEN];
+
+static uint32_t classify(void) {
+  uint32_t counts[4] = {0, 0, 0, 0};
+  for (int i = 0; i < DATA_LEN; i++) {
+    uint32_t v = data[i];
+    if (v & 1) {
+      if (v & 0x100)
+        counts[0]++;
+      else
+        counts[1] += v >> 28;
+    } else if (v < 0x40000000) {
+      counts[2]++;
+    } else {
+      counts[3] ^= v;
+    }
+  }
+  return counts[0] + counts[1] * 3 + counts[2] * 5 + counts[3];
+}
+
+static uint32_t state_machine(void) {
+  uint32_t state = 0, acc = 0;
+  for (int i = 0; i < DATA_LEN; i++) {
+    uint32_t in = data[i] >> 29;
+    switch (state) {
+      case 0:
+        state = in < 4 ? 1 : 2;
+        acc += in;
+        break;
+      case 1:
+        state = in == 7 ? 0 : 3;
+        acc ^= in << 3;
+        break;
+      case 2:
+        state = in & 1 ? 4 : 1;
+        acc += acc >> 5;
+        break;
+      case 3:
+        state = in > 2 ? 2 : 0;
+        acc -= in;
+        break;
+      default:
+        state = 0;
+        acc = acc * 3 + 1;
+        break;
+    }
+  }
+  return acc + state;
+}
+
+static uint32_t search(uint32_t seed) {
+  uint32_t found = 0;
+  for (int s = 0; s < SEARCHES; s++) {
+    uint32_t key = (s & 1) ? sorted[bench_rand(&seed) % DATA_LEN]
+                           : bench_rand(&seed);
+    int lo = 0, hi = DATA_LEN - 1;
+    while (lo <= hi) {
+      int mid = (lo + hi) / 2;
+      if (sorted[mid] == key) {
+        found += mid;
+        break;
+      } else if (sorted[mid] < key) {
+        lo = mid + 1;
+      } else {
+        hi = mid - 1;
+      }
+    }
+  }
+  return found;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  for (int i = 0; i < DATA_LEN; i++)
+    data[i] = bench_rand(&seed);
+  // strictly increasing values with random gaps
+  uint32_t v = 0;
+  for (int i = 0; i < DATA_LEN; i++) {
+    v += 1 + (bench_rand(&seed) >> 22);
+    sorted[i] = v;
+  }
+
+  bench_start("branch");
+  uint32_t result = 0;
+  for (int it = 0; it < BENCH_ITERATIONS; it++) {
+    uint32_t start = bench_mcycle();
+    uint32_t r = classify();
+    bench_phase("classify", start, 0);
+    start = bench_mcycle();
+    r += state_machine();
+    bench_phase("state_machine", start, 0);
+    start = bench_mcycle();
+    r ^= search(1);
+    bench_phase("search", start, 0);
+    result = bench_merge(it, result, r);
+  }
+  return bench_finish("branch", result, BENCH_BRANCH_EXPECTED);
+}
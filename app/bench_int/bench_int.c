@@ -0,0 +1,107 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Integer kernels: bitwise CRC-32, matrix multiplication, insertion sort and
+// a division heavy GCD loop.
+
+#include "bench.h"
+
+// checksum of a correct run, independent of BENCH_ITERATIONS
+#define BENCH_INT_EXPECTED 0xD1307FA7
+
+#define CRC_LEN 1024
+#define MAT_N 16
+#define SORT_LEN 256
+#define GCD_PAIRS 256
+
+static uint8_t crc_buf[CRC_LEN];
+static int32_t mat_a[MAT_N][MAT_N], mat_b[MAT_N][MAT_N], mat_c[MAT_N][MAT_N];
+static uint32_t sort_buf[SORT_LEN];
+
+static uint32_t crc32(const uint8_t *buf, uint32_t len) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < len; i++) {
+    crc ^= buf[i];
+    for (int b = 0; b < 8; b++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static uint32_t matmul(void) {
+  uint32_t sum = 0;
+  for (int i = 0; i < MAT_N; i++) {
+    for (int j = 0; j < MAT_N; j++) {
+      int32_t acc = 0;
+      for (int k = 0; k < MAT_N; k++)
+        acc += mat_a[i][k] * mat_b[k][j];
+      mat_c[i][j] = acc;
+      sum += acc;
+    }
+  }
+  return sum;
+}
+
+static uint32_t sort(uint32_t seed) {
+  for (int i = 0; i < SORT_LEN; i++)
+    sort_buf[i] = bench_rand(&seed);
+  for (int i = 1; i < SORT_LEN; i++) {
+    uint32_t v = sort_buf[i];
+    int j = i - 1;
+    while (j >= 0 && sort_buf[j] > v) {
+      sort_buf[j + 1] = sort_buf[j];
+      j--;
+    }
+    sort_buf[j + 1] = v;
+  }
+  uint32_t sum = 0;
+  for (int i = 0; i < SORT_LEN; i++)
+    sum = sum * 31 + sort_buf[i];
+  return sum;
+}
+
+static uint32_t gcd_sum(uint32_t seed) {
+  uint32_t sum = 0;
+  for (int i = 0; i < GCD_PAIRS; i++) {
+    uint32_t a = bench_rand(&seed) >> 8, b = bench_rand(&seed) >> 16;
+    while (b) {
+      uint32_t t = a % b;
+      a = b;
+      b = t;
+    }
+    sum += a;
+  }
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  for (int i = 0; i < CRC_LEN; i++)
+    crc_buf[i] = bench_rand(&seed) >> 24;
+  for (int i = 0; i < MAT_N; i++) {
+    for (int j = 0; j < MAT_N; j++) {
+      mat_a[i][j] = (int32_t)bench_rand(&seed) >> 20;
+      mat_b[i][j] = (int32_t)bench_rand(&seed) >> 20;
+    }
+  }
+
+  bench_start("int");
+  uint32_t result = 0;
+  for (int it = 0; it < BENCH_ITERATIONS; it++) {
+    uint32_t start = bench_mcycle();
+    uint32_t r = crc32(crc_buf, CRC_LEN);
+    bench_phase("crc32", start, CRC_LEN);
+    start = bench_mcycle();
+    r += matmul();
+    bench_phase("matmul", start, 0);
+    start = bench_mcycle();
+    r ^= sort(1);
+    bench_phase("sort", start, 0);
+    start = bench_mcycle();
+    r += gcd_sum(1);
+    bench_phase("gcd", start, 0);
+    result = bench_merge(it, result, r);
+  }
+  return bench_finish("int", result, BENCH_INT_EXPECTED);
+}
@@ -0,0 +1,70 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Memory bandwidth: word and byte copies and word fills over buffers larger
+// than any adapter cache, with the cycles of every phase printed so the
+// bytes per cycle can be computed.
+
+#include "bench.h"
+
+// checksum of a correct run, independent of BENCH_ITERATIONS
+#define BENCH_MEM_EXPECTED 0x6FC90F4A
+
+#define BUF_WORDS 4096  // 16 KiB per buffer
+
+static uint32_t src[BUF_WORDS], dst[BUF_WORDS];
+
+static void copy_words(uint32_t *d, const uint32_t *s, uint32_t n) {
+  for (uint32_t i = 0; i < n; i += 4) {
+    d[i] = s[i];
+    d[i + 1] = s[i + 1];
+    d[i + 2] = s[i + 2];
+    d[i + 3] = s[i + 3];
+  }
+}
+
+static void copy_bytes(uint8_t *d, const uint8_t *s, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++)
+    d[i] = s[i];
+}
+
+static void fill_words(uint32_t *d, uint32_t v, uint32_t n) {
+  for (uint32_t i = 0; i < n; i++)
+    d[i] = v;
+}
+
+static uint32_t sum_words(const uint32_t *s, uint32_t n) {
+  uint32_t sum = 0;
+  for (uint32_t i = 0; i < n; i++)
+    sum += s[i] ^ i;
+  return sum;
+}
+
+int main(int argc, char **argv) {
+  uint32_t seed = 1;
+  for (int i = 0; i < BUF_WORDS; i++)
+    src[i] = bench_rand(&seed);
+
+  bench_start("mem");
+  uint32_t result = 0;
+  for (int it = 0; it < BENCH_ITERATIONS; it++) {
+    uint32_t start = bench_mcycle();
+    fill_words(dst, 0, BUF_WORDS);
+    bench_phase("memset_word", start, sizeof(dst));
+    start = bench_mcycle();
+    copy_words(dst, src, BUF_WORDS);
+    bench_phase("memcpy_word", start, sizeof(dst));
+    uint32_t r = sum_words(dst, BUF_WORDS);
+    start = bench_mcycle();
+    // unaligned byte copy of all but the first and last word
+    copy_bytes((uint8_t *)dst + 1, (const uint8_t *)src + 3,
+               sizeof(dst) - 8);
+    bench_phase("memcpy_byte", start, sizeof(dst) - 8);
+    start = bench_mcycle();
+    r += sum_words(dst, BUF_WORDS);
+    bench_phase("read_word", start, sizeof(dst));
+    result = bench_merge(it, result, r);
+  }
+  return bench_finish("mem", result, BENCH_MEM_EXPECTED);
+}
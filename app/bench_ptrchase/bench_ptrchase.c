@@ -0,0 +1,56 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Pointer chasing: every load depends on the previous one, so the run time
+// is dominated by the load latency of the memory system. The chain visits the
+// nodes of a single random cycle, each on its own 32-byte line.
+
+#include "bench.h"
+
+// checksum of a correct run, independent of BENCH_ITERATIONS
+#define BENCH_PTRCHASE_EXPECTED 0xE8557000
+
+#define NODES 2048  // 64 KiB
+#define STEPS (4 * NODES)
+
+struct node {
+  struct node *next;
+  uint32_t value;
+  uint32_t pad[6];
+};
+
+static struct node nodes[NODES];
+static uint16_t order[NODES];
+
+int main(int argc, char **argv) {
+  // Sattolo's algorithm gives a random permutation with a single cycle
+  uint32_t seed = 1;
+  for (int i = 0; i < NODES; i++)
+    order[i] = i;
+  for (int i = NODES - 1; i > 0; i--) {
+    int j = bench_rand(&seed) % i;
+    uint16_t t = order[i];
+    order[i] = order[j];
+    order[j] = t;
+  }
+  for (int i = 0; i < NODES; i++) {
+    nodes[i].next = &nodes[order[i]];
+    nodes[i].value = bench_rand(&seed);
+  }
+
+  bench_start("ptrchase");
+  uint32_t result = 0;
+  for (int it = 0; it < BENCH_ITERATIONS; it++) {
+    uint32_t start = bench_mcycle();
+    const struct node *n = &nodes[0];
+    uint32_t r = 0;
+    for (int s = 0; s < STEPS; s++) {
+      r += n->value;
+      n = n->next;
+    }
+    bench_phase("chase", start, STEPS * sizeof(void *));
+    result = bench_merge(it, result, r);
+  }
+  return bench_finish("ptrchase", result, BENCH_PTRCHASE_EXPECTED);
+}
@@ -0,0 +1,40 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Timer interrupt stress: a short timer period interrupts a compute loop
+// over and over, which exercises interrupt entry and exit and the timer
+// device. The second phase sleeps in WFI between the interrupts.
+
+#include "bench.h"
+
+#define TIMER_PERIOD 500  // cycles
+#define TIMER_IRQS 200
+
+int main(int argc, char **argv) {
+  bench_start("timer");
+  uint32_t result = 0;
+  for (int it = 0; it < BENCH_ITERATIONS; it++) {
+    uint32_t start = bench_mcycle();
+    uint32_t work = 0;
+    timer_enable(TIMER_PERIOD);
+    while (get_elapsed_time() < TIMER_IRQS)
+      work = work * 1103515245 + 12345;
+    timer_disable();
+    bench_phase("busy", start, 0);
+    uint32_t r = get_elapsed_time() >= TIMER_IRQS;
+
+    start = bench_mcycle();
+    timer_enable(TIMER_PERIOD);
+    while (get_elapsed_time() < TIMER_IRQS)
+      asm volatile("wfi");
+    timer_disable();
+    bench_phase("sleep", start, 0);
+    r += get_elapsed_time() >= TIMER_IRQS;
+
+    // the work result varies with the interrupt timing, keep it alive only
+    asm volatile("" : : "r"(work));
+    result = bench_merge(it, result, r);
+  }
+  return bench_finish("timer", result, 2);
+}
@@ -0,0 +1,107 @@
+// Copyright lowRISC contributors.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+
+// Helpers shared by the bench_* applications. Each benchmark measures its
+// region of interest between bench_start() and bench_finish(), so the
+// performance counters the adapter reports at exit only cover that region.
+
+#ifndef BENCH_H__
+#define BENCH_H__
+
+#include "simple_system_common.h"
+
+// Number of times the kernel is repeated, override with
+// make PROGRAM_CFLAGS=-DBENCH_ITERATIONS=<n>
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 4
+#endif
+
+static inline uint32_t bench_mcycle() {
+  uint32_t cycles;
+  PCOUNT_READ(mcycle, cycles);
+  return cycles;
+}
+
+/**
+ * Resets and enables the performance counters.
+ *
+ * @param name Benchmark name used in the output
+ */
+static inline void bench_start(const char *name) {
+  puts("bench ");
+  puts(name);
+  puts(" start\n");
+  pcount_enable(0);
+  pcount_reset();
+  pcount_enable(1);
+}
+
+/**
+ * Prints the cycles of one phase of a benchmark.
+ *
+ * @param phase Name of the phase
+ * @param start mcycle at the beginning of the phase
+ * @param bytes Bytes moved in the phase, 0 if not applicable
+ */
+static inline void bench_phase(const char *phase, uint32_t start,
+                               uint32_t bytes) {
+  uint32_t cycles = bench_mcycle() - start;
+  puts("bench phase ");
+  puts(phase);
+  puts(" cycles=0x");
+  puthex(cycles);
+  if (bytes) {
+    puts(" bytes=0x");
+    puthex(bytes);
+  }
+  putchar('\n');
+}
+
+// Iterations whose checksum differed from the previous one
+static uint32_t bench_mismatches;
+
+/**
+ * Combines the checksums of the iterations of a benchmark. All iterations
+ * work on the same input, so they all have to compute the same checksum.
+ *
+ * @param it Iteration number
+ * @param result Checksum of the previous iteration
+ * @param r Checksum of this iteration
+ * @returns Checksum of this iteration
+ */
+static inline uint32_t bench_merge(int it, uint32_t result, uint32_t r) {
+  if (it != 0 && r != result)
+    bench_mismatches++;
+  return r;
+}
+
+/**
+ * Stops the performance counters, checks the result and prints the counters.
+ *
+ * @param name Benchmark name used in the output
+ * @param result Checksum computed by the benchmark
+ * @param expected Checksum of a correct run
+ * @returns 0 if the result matches
+ */
+static inline int bench_finish(const char *name, uint32_t result,
+                               uint32_t expected) {
+  pcount_enable(0);
+  int fail = result != expected || bench_mismatches != 0;
+  puts("bench ");
+  puts(name);
+  puts(fail ? " FAIL" : " ok");
+  puts(" result=0x");
+  puthex(result);
+  putchar('\n');
+  pcount_dump();
+  return fail;
+}
+
+// Small deterministic generator for benchmark inputs
+static inline uint32_t bench_rand(uint32_t *state) {
+  *state = *state * 1664525u + 1013904223u;
+  return *state;
+}
+
+#endif  // BENCH_H__
@@ -9,6 +9,8 @@ INCS := -I$(COMMON_DIR)
 
 # ARCH = rv32im # to disable compressed instructions
 ARCH ?= rv32imc
+# ARCH = rv32emc ABI = ilp32e # for the rv32e configuration of the core
+ABI ?= ilp32
 
 ifdef PROGRAM
 PROGRAM_C := $(PROGRAM).c
@@ -27,7 +29,7 @@ OBJDUMP ?= $(CROSS_COMPILE)objdump
 
 LINKER_SCRIPT ?= $(COMMON_DIR)/link.ld
 CRT ?= $(COMMON_DIR)/crt0.S
-CFLAGS ?= -march=$(ARCH) -mabi=ilp32 -static -mcmodel=medany -Wall -g -Os\
+CFLAGS ?= -march=$(ARCH) -mabi=$(ABI) -static -mcmodel=medany -Wall -g -Os\
 	-fvisibility=hidden -nostdlib -nostartfiles -ffreestanding $(PROGRAM_CFLAGS)
 
 OBJS := ${C_SRCS:.c=.o} ${ASM_SRCS:.S=.o} ${CRT:.S=.o}
@@ -102,6 +102,42 @@ void pcount_reset() {
       "csrw mhpmcounter31h, x0\n");
 }
 
+// Reads a 64-bit counter CSR, retrying if the low half wrapped in between
+#define PCOUNT_READ64(name)             \
+  ({                                    \
+    uint32_t hi, lo, hi2;               \
+    do {                                \
+      PCOUNT_READ(name##h, hi);         \
+      PCOUNT_READ(name, lo);            \
+      PCOUNT_READ(name##h, hi2);        \
+    } while (hi != hi2);                \
+    ((uint64_t)hi << 32) | lo;          \
+  })
+
+static void pcount_put(const char *name, uint64_t value) {
+  puts("pcount ");
+  puts(name);
+  puts("=0x");
+  puthex(value >> 32);
+  puthex(value);
+  putchar('\n');
+}
+
+void pcount_dump() {
+  pcount_put("mcycle", PCOUNT_READ64(mcycle));
+  pcount_put("minstret", PCOUNT_READ64(minstret));
+  pcount_put("lsu_wait", PCOUNT_READ64(mhpmcounter3));
+  pcount_put("ifetch_wait", PCOUNT_READ64(mhpmcounter4));
+  pcount_put("loads", PCOUNT_READ64(mhpmcounter5));
+  pcount_put("stores", PCOUNT_READ64(mhpmcounter6));
+  pcount_put("jumps", PCOUNT_READ64(mhpmcounter7));
+  pcount_put("branches", PCOUNT_READ64(mhpmcounter8));
+  pcount_put("branches_taken", PCOUNT_READ64(mhpmcounter9));
+  pcount_put("compressed", PCOUNT_READ64(mhpmcounter10));
+  pcount_put("mul_wait", PCOUNT_READ64(mhpmcounter11));
+  pcount_put("div_wait", PCOUNT_READ64(mhpmcounter12));
+}
+
 unsigned int get_mepc() {
   uint32_t result;
   __asm__ volatile("csrr %0, mepc;" : "=r"(result));
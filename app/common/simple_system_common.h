@@ -66,6 +66,13 @@ static inline void pcount_enable(int enable) {
  */
 void pcount_reset();
 
+/**
+ * Writes mcycle, minstret and mhpmcounter3 to mhpmcounter12 to simulator out
+ * log, one `pcount <name>=0x<value>` line per counter, using the same names
+ * as the adapter report at exit.
+ */
+void pcount_dump();
+
 /**
  * Enables timer interrupt
  *
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+# Copyright 2025 Max Planck Institute for Software Systems, and
+# National University of Singapore
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+Runs the benchmarks of run_benchmarks.py twice, once in the detailed model as
+the reference and once in the mode under test, and checks that the guest ends
+in the same state:
+
+  ff          functional fast-forward, the first --ff-insns instructions on
+              the simulator, or sampling with --ff-window and --ff-period.
+              The result and checksum of every benchmark have to match, and
+              the retired instructions may differ by --tolerance percent. The
+              handoff program retires about 50 instructions per handoff.
+  chan-batch  channel batching against --no-chan-batch. Every guest counter
+              has to match, and the channel polls and syncs per cycle and
+              the simulation speed of both runs are printed.
+
+Each benchmark runs once per memory channel latency in --latency, with a sync
+period of the same length. Exits with 1 if a benchmark does not match.
+"""
+
+import argparse
+import os
+import sys
+
+import run_benchmarks
+import run_sweep
+
+# interrupts arrive at other instructions when the timing changes
+TIMING_DEPENDENT = {"bench_timer"}
+
+
+def deviation(value: int | None, base: int | None) -> float | None:
+    if not value or not base:
+        return None
+    return round(100 * (value - base) / base, 3)
+
+
+def compare_results(ref: dict, run: dict) -> list[str]:
+    errors = []
+    if ref["status"] != "ok" or run["status"] != "ok":
+        errors.append(f"status {ref['status']}/{run['status']}")
+    elif ref.get("result") != run.get("result"):
+        errors.append(f"result {ref.get('result', 0):#x}/{run.get('result', 0):#x}")
+    return errors
+
+
+def compare_ff(bench: str, ref: dict, run: dict, args: argparse.Namespace) -> list[str]:
+    """Differences in the final guest state, empty if the runs agree."""
+    errors = compare_results(ref, run)
+    dev = deviation(run.get("minstret"), ref.get("minstret"))
+    if dev is None:
+        errors.append("no minstret")
+    elif abs(dev) > args.tolerance and bench not in TIMING_DEPENDENT:
+        errors.append(f"minstret {ref['minstret']}/{run['minstret']}")
+    return errors
+
+
+def compare_chan_batch(bench: str, ref: dict, run: dict, args: argparse.Namespace) -> list[str]:
+    """Batching must not move a completion by a cycle, so all guest counters and
+    phase cycles are identical."""
+    errors = compare_results(ref, run)
+    if "mcycle" not in ref:
+        errors.append("no mcycle")
+    # everything but the host side of the run
+    simulated = [
+        k
+        for k in ref
+        if k not in ("status", "result", "run_s") and (k == "sim_cycles" or not k.startswith("sim_"))
+    ]
+    errors += [f"{k} {ref[k]}/{run.get(k)}" for k in simulated if ref[k] != run.get(k)]
+    return errors
+
+
+# the comparison and the adapter statistics to print for both runs
+MODES = {
+    "ff": (compare_ff, []),
+    "chan-batch": (compare_chan_batch, ["sim_polls_per_cycle", "sim_syncs_per_cycle", "sim_khz"]),
+}
+LABELS = {"sim_polls_per_cycle": "polls/cycle", "sim_syncs_per_cycle": "syncs/cycle", "sim_khz": "khz"}
+
+
+def mode_env(args: argparse.Namespace) -> tuple[dict, dict]:
+    """Environment of the reference run and of the run under test."""
+    if args.mode == "chan-batch":
+        return {"IBEX_CHAN_BATCH": "0"}, {"IBEX_CHAN_BATCH": "1"}
+    if args.ff_window or args.ff_period:
+        return {}, {"IBEX_FF_WINDOW": str(args.ff_window or ""), "IBEX_FF_PERIOD": str(args.ff_period or "")}
+    return {}, {"IBEX_FF_INSNS": str(args.ff_insns)}
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument("mode", choices=list(MODES))
+    parser.add_argument("benchmarks", nargs="*", default=run_benchmarks.BENCHMARKS)
+    parser.add_argument("--out", default="/tmp/ibex-compare", help="directory for the adapter output")
+    parser.add_argument("--variant", default="", help="adapter build variant (IbexSim.variant)")
+    parser.add_argument("--config", default="", help="Ibex configuration (IbexSim.config)")
+    parser.add_argument(
+        "--harvard",
+        action="store_true",
+        help="fetch instructions from a separate memory (IbexHost harvard mode)",
+    )
+    parser.add_argument(
+        "--latency",
+        type=run_sweep.int_list,
+        default=[500],
+        help="comma separated memory channel latencies in ns",
+    )
+    parser.add_argument(
+        "--ff-insns",
+        type=int,
+        default=10000,
+        help="instructions on the functional simulator before the handoff (IbexSim.ff_insns)",
+    )
+    parser.add_argument("--ff-window", type=int, help="sample: cycles per detailed window")
+    parser.add_argument("--ff-period", type=int, help="sample: functional instructions in between")
+    parser.add_argument(
+        "--tolerance",
+        type=float,
+        default=1.0,
+        help="deviation of the retired instructions in percent",
+    )
+    parser.add_argument("--csv", help="write the results of both runs as CSV")
+    parser.add_argument("--json", help="write the results of both runs as JSON")
+    parser.add_argument("--verbose", action="store_true", help="show the simulation output")
+    parser.add_argument(
+        "--run",
+        default="simbricks-run --verbose",
+        help="command that runs a virtual prototype script",
+    )
+    args = parser.parse_args()
+    args.run = args.run.split()
+    args.no_chan_batch = False
+
+    compare, stats = MODES[args.mode]
+    ref_env, run_env = mode_env(args)
+    runs = {"ref": ref_env, args.mode: run_env}
+
+    results = []
+    failed = False
+    # every column pair is the reference run, then the one under test
+    columns = ["mcycle", "minstret"] + stats + ["run_s"]
+    print(f"{'':16} {'latency':>7}" + "".join(f" {LABELS.get(c, c):>21}" for c in columns))
+    for latency in args.latency:
+        for bench in args.benchmarks:
+            pair = {}
+            for name, extra_env in runs.items():
+                out = os.path.join(args.out, f"{name}-l{latency}")
+                os.makedirs(out, exist_ok=True)
+                env = extra_env | {"IBEX_LATENCY_NS": str(latency), "IBEX_SYNC_NS": str(latency)}
+                pair[name] = run_benchmarks.run_benchmark(bench, args.config, args, out=out, extra_env=env)
+                results.append({"run": name, "latency_ns": latency} | pair[name])
+            ref, run = pair["ref"], pair[args.mode]
+            errors = compare(bench, ref, run, args)
+            failed |= bool(errors)
+            print(
+                f"{bench:16} {latency:>7}"
+                + "".join(f" {ref.get(c, '-'):>10} {run.get(c, '-'):>10}" for c in columns)
+                + " "
+                + (", ".join(errors) if errors else "match")
+                + (" (timing dependent)" if args.mode == "ff" and bench in TIMING_DEPENDENT else "")
+            )
+
+    run_benchmarks.write_results(results, args)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
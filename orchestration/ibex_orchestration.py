@@ -33,14 +33,30 @@ from simbricks.orchestration.instantiation import socket as inst_socket
 
 
 class IbexHost(sys.Component):
-    def __init__(self, s: sys.System) -> None:
+    def __init__(self, s: sys.System, harvard: bool = False, cores: int = 1) -> None:
         super().__init__(s)
-        self._mem_if: sys.MemHostInterface = sys.MemHostInterface(self)
-        self.ifs.append(self._mem_if)
+        # one memory interface per core, all simulated by one adapter process;
+        # _mem_if is the one of the first core
+        self._mem_ifs: list[sys.MemHostInterface] = [
+            sys.MemHostInterface(self) for _ in range(cores)
+        ]
+        self.ifs.extend(self._mem_ifs)
+        self._mem_if: sys.MemHostInterface = self._mem_ifs[0]
+        # with harvard=True instruction fetches use a separate interface per
+        # core and _mem_ifs only carry data accesses
+        self._imem_ifs: list[sys.MemHostInterface] = []
+        if harvard:
+            self._imem_ifs = [sys.MemHostInterface(self) for _ in range(cores)]
+            self.ifs.extend(self._imem_ifs)
+        self._imem_if: sys.MemHostInterface | None = (
+            self._imem_ifs[0] if self._imem_ifs else None
+        )
 
     def toJSON(self) -> dict:
         json_obj = super().toJSON()
         json_obj["mem_if"] = self._mem_if.id()
+        json_obj["mem_ifs"] = [mem_if.id() for mem_if in self._mem_ifs]
+        json_obj["imem_ifs"] = [imem_if.id() for imem_if in self._imem_ifs]
         return json_obj
 
     @classmethod
@@ -49,6 +65,15 @@ class IbexHost(sys.Component):
         mem_if_id = int(utils_base.get_json_attr_top(json_obj, "mem_if"))
         instance._mem_if = system.get_inf(mem_if_id)
         print("in restore:", instance._mem_if)
+        instance._mem_ifs = [
+            system.get_inf(int(inf_id))
+            for inf_id in utils_base.get_json_attr_top(json_obj, "mem_ifs")
+        ]
+        instance._imem_ifs = [
+            system.get_inf(int(inf_id))
+            for inf_id in utils_base.get_json_attr_top(json_obj, "imem_ifs")
+        ]
+        instance._imem_if = instance._imem_ifs[0] if instance._imem_ifs else None
         return instance
 
 
@@ -64,10 +89,116 @@ class IbexSim(sim_base.Simulator):
         )
         self.name = f"IbexSim-{self._id}"
         self.clock_freq = 250  # MHz
+        # adapter build variant (see the Makefile), "" is the default build
+        self.variant = ""
+        # Ibex configuration (see the Makefile), "" keeps the ibex_top defaults.
+        # Configurations are built with the flags of the fast variant and take
+        # precedence over variant.
+        self.config = ""
+        # Verilator runtime plusargs, e.g. "+verilator+seed+1"
+        self.verilator_args: list[str] = []
+        self.icache_size = 0  # bytes, 0 disables the adapter instruction cache
+        self.icache_line = 32  # bytes
+        self.icache_hit_latency = 1  # cycles
+        # (base, size) address ranges the data cache and write combining apply
+        # to, e.g. [(0x100000, 0x38000)] for the RAM and stack of app/
+        self.cacheable: list[tuple[int, int]] = []
+        self.dcache_size = 0  # bytes, 0 disables the write-through data cache
+        self.dcache_line = 32  # bytes
+        self.dcache_hit_latency = 1  # cycles
+        self.wcb_size = 0  # bytes, 0 disables the write-combining buffer
+        self.wcb_timeout = 64  # cycles
+        # (base, size) address ranges served from adapter-local memory
+        self.local_mem: list[tuple[int, int]] = []
+        # ELF file loaded into the local ranges, usually the one given to the
+        # memory device
+        self.local_elf: str | None = None
+        self.local_mem_latency = 1  # cycles
+        # skip cycles while the core sleeps in WFI with nothing in flight
+        self.wfi_skip = True
+        # only sync and poll the memory channel when the sync interval or the
+        # next incoming message requires it
+        self.chan_batch = True
+        # mtime/mtimecmp timer inside the adapter, None leaves the range to
+        # the memory channel
+        self.timer_base: int | None = 0x30000
+        # simulation control block, its halt register is handled by the adapter
+        self.sim_ctrl_base = 0x20000
+        # write the character output of the firmware to this file ("-" for
+        # stdout) instead of sending it to a terminal device, None disables it
+        self.console: str | None = None
+        # waveform trace file, None disables tracing
+        self.trace_file: str | None = None
+        self.trace_level = 40
+        # simulated time window in ps, None leaves that end open
+        self.trace_start: int | None = None
+        self.trace_stop: int | None = None
+        # start tracing on a fetch from / data access to this address
+        self.trace_pc: int | None = None
+        self.trace_addr: int | None = None
+        # binary trace of the retired instructions, needs the rvfi variant
+        self.rvfi_trace: str | None = None
+        # sampling profile of the guest PC, symbolized with profile_elf
+        # (default: local_elf); profile_format is "flat" or "folded"
+        self.profile_file: str | None = None
+        self.profile_interval = 1000  # cycles
+        self.profile_elf: str | None = None
+        self.profile_format = "flat"
+        # JSON file with memory access counts per region and page and stack
+        # distance histograms, regions from the sections of mem_stats_elf
+        # (default: local_elf)
+        self.mem_stats_file: str | None = None
+        self.mem_stats_elf: str | None = None
+        self.mem_stats_line = 32  # bytes
+        self.mem_stats_page = 4096  # bytes
+        # (base, size) of the stack region, None keeps the stack of app/
+        self.mem_stats_stack: tuple[int, int] | None = None
+        # JSON lines file with periodic statistics, None disables it
+        self.stats_file: str | None = None
+        self.stats_interval = 1000000  # cycles
+        # JSON file with the guest performance counters at exit
+        self.pcount_file: str | None = None
+        # write a checkpoint to this file at checkpoint_at ps (or on SIGHUP)
+        # and optionally end the simulation afterwards
+        self.checkpoint_file: str | None = None
+        self.checkpoint_at: int | None = None
+        self.checkpoint_exit = False
+        # resume from this checkpoint
+        self.restore_file: str | None = None
+        # log the messages from the memory side to record_file, or serve them
+        # from replay_file instead of connecting to the memory channel
+        self.record_file: str | None = None
+        self.replay_file: str | None = None
+        # end the run after hang_cycles cycles in a loop of at most hang_span
+        # bytes without stores or without a retired instruction (0 disables
+        # it), except for loops that fetch from an address or (base, size)
+        # range in hang_idle
+        self.hang_cycles = 0
+        self.hang_span = 64  # bytes
+        self.hang_idle: list[int | tuple[int, int]] = []
+        # simulated time in ps and wall-clock seconds after which the run ends
+        self.sim_limit: int | None = None
+        self.wall_limit: float | None = None
+        # cycles between barriers of the cores of a multi-core IbexHost, None
+        # uses the sync interval
+        self.core_quantum: int | None = None
+        # run functionally until this many instructions retired, this PC is
+        # reached or this simulated time in ps, then switch to the model
+        self.ff_insns: int | None = None
+        self.ff_until_pc: int | None = None
+        self.ff_until: int | None = None
+        # sampling: detailed windows of ff_window cycles every ff_period
+        # functionally executed instructions, both or neither have to be set
+        self.ff_window: int | None = None
+        self.ff_period: int | None = None
+
+    def resreq_cores(self) -> int:
+        # one thread per Ibex core
+        return len(self.filter_components_by_type(ty=IbexHost)[0]._mem_ifs)
 
     def resreq_mem(self) -> int:
         # this is a guess
-        return 512
+        return 512 * self.resreq_cores()
 
     def run_cmd(self, inst: inst_base.Instantiation) -> str:
         ibex_comps = self.filter_components_by_type(ty=IbexHost)
@@ -80,29 +211,275 @@ class IbexSim(sim_base.Simulator):
         mem_latency, mem_sync_period, mem_run_sync = (
             sim_base.Simulator.get_unique_latency_period_sync(mem_channels)
         )
-        socket = inst.get_socket(interface=ibex_comp._mem_if)
-        mem_params_url = self.get_parameters_url(
-            inst,
-            socket,
-            sync=mem_run_sync,
-            latency=mem_latency,
-            sync_period=mem_sync_period,
-        )
 
-        cmd = (
-            f"{self._executable} {mem_params_url} {self._start_tick} {self.clock_freq}"
-        )
+        def params_url(interface: sys.MemHostInterface) -> str:
+            return self.get_parameters_url(
+                inst,
+                inst.get_socket(interface=interface),
+                sync=mem_run_sync,
+                latency=mem_latency,
+                sync_period=mem_sync_period,
+            )
+
+        mem_params_url = params_url(ibex_comp._mem_if)
+
+        opts = ""
+        for mem_if in ibex_comp._mem_ifs[1:]:
+            opts += f" --core-mem={params_url(mem_if)}"
+        for imem_if in ibex_comp._imem_ifs:
+            opts += f" --instr-mem={params_url(imem_if)}"
+        if self.core_quantum is not None:
+            opts += f" --core-quantum={self.core_quantum}"
+        if self.icache_size:
+            opts += (
+                f" --icache-size={self.icache_size}"
+                f" --icache-line={self.icache_line}"
+                f" --icache-hit-latency={self.icache_hit_latency}"
+            )
+        for base, size in self.cacheable:
+            opts += f" --cacheable={base:#x}:{size:#x}"
+        if self.dcache_size:
+            opts += (
+                f" --dcache-size={self.dcache_size}"
+                f" --dcache-line={self.dcache_line}"
+                f" --dcache-hit-latency={self.dcache_hit_latency}"
+            )
+        if self.wcb_size:
+            opts += f" --wcb-size={self.wcb_size} --wcb-timeout={self.wcb_timeout}"
+
+        for base, size in self.local_mem:
+            opts += f" --local-mem={base:#x}:{size:#x}"
+        if self.local_mem:
+            opts += f" --local-mem-latency={self.local_mem_latency}"
+        if self.local_elf:
+            opts += f" --local-elf={self.local_elf}"
+        if not self.wfi_skip:
+            opts += " --no-wfi-skip"
+        if not self.chan_batch:
+            opts += " --no-chan-batch"
+        if self.timer_base is None:
+            opts += " --no-timer"
+        else:
+            opts += f" --timer-base={self.timer_base:#x}"
+        opts += f" --sim-ctrl-base={self.sim_ctrl_base:#x}"
+        if self.console:
+            opts += f" --console={self.console}"
+        if self.trace_file:
+            opts += f" --trace={self.trace_file} --trace-level={self.trace_level}"
+            if self.trace_start is not None:
+                opts += f" --trace-start={self.trace_start}"
+            if self.trace_stop is not None:
+                opts += f" --trace-stop={self.trace_stop}"
+            if self.trace_pc is not None:
+                opts += f" --trace-pc={self.trace_pc:#x}"
+            if self.trace_addr is not None:
+                opts += f" --trace-addr={self.trace_addr:#x}"
+        if self.rvfi_trace:
+            opts += f" --rvfi-trace={self.rvfi_trace}"
+        if self.profile_file:
+            opts += (
+                f" --profile={self.profile_file} --profile-interval={self.profile_interval}"
+                f" --profile-format={self.profile_format}"
+            )
+            if self.profile_elf:
+                opts += f" --profile-elf={self.profile_elf}"
+        if self.mem_stats_file:
+            opts += (
+                f" --mem-stats={self.mem_stats_file} --mem-stats-line={self.mem_stats_line}"
+                f" --mem-stats-page={self.mem_stats_page}"
+            )
+            if self.mem_stats_stack is not None:
+                base, size = self.mem_stats_stack
+                opts += f" --mem-stats-stack={base:#x}:{size:#x}"
+            if self.mem_stats_elf:
+                opts += f" --mem-stats-elf={self.mem_stats_elf}"
+
+        executable = self._executable
+        if self.config:
+            executable += f"-cfg-{self.config}"
+        elif self.variant:
+            executable += f"-{self.variant}"
+        plusargs = "".join(f" {arg}" for arg in self.verilator_args)
+
+        if self.stats_file:
+            opts += f" --stats-file={self.stats_file} --stats-interval={self.stats_interval}"
+
+        if self.pcount_file:
+            opts += f" --pcount-file={self.pcount_file}"
+
+        if self.checkpoint_file:
+            opts += f" --checkpoint={self.checkpoint_file}"
+            if self.checkpoint_at is not None:
+                opts += f" --checkpoint-at={self.checkpoint_at}"
+            if self.checkpoint_exit:
+                opts += " --checkpoint-exit"
+        if self.restore_file:
+            opts += f" --restore={self.restore_file}"
+        if self.record_file:
+            opts += f" --record={self.record_file}"
+        if self.replay_file:
+            opts += f" --replay={self.replay_file}"
+        if self.hang_cycles:
+            opts += f" --hang-cycles={self.hang_cycles} --hang-span={self.hang_span}"
+            for idle in self.hang_idle:
+                if isinstance(idle, int):
+                    opts += f" --hang-idle={idle:#x}"
+                else:
+                    opts += f" --hang-idle={idle[0]:#x}:{idle[1]:#x}"
+        if self.sim_limit is not None:
+            opts += f" --sim-limit={self.sim_limit}"
+        if self.wall_limit is not None:
+            opts += f" --wall-limit={self.wall_limit}"
+
+        if self.ff_insns is not None:
+            opts += f" --ff-insns={self.ff_insns}"
+        if self.ff_until_pc is not None:
+            opts += f" --ff-until-pc={self.ff_until_pc:#x}"
+        if self.ff_until is not None:
+            opts += f" --ff-until={self.ff_until}"
+        if (self.ff_window is None) != (self.ff_period is None):
+            raise ValueError(f"{self.name}: ff_window and ff_period are only used together")
+        if self.ff_window is not None:
+            opts += f" --ff-window={self.ff_window}"
+        if self.ff_period is not None:
+            opts += f" --ff-period={self.ff_period}"
+
+        cmd = f"{executable}{opts} {mem_params_url} {self._start_tick} {self.clock_freq}{plusargs}"
         return cmd
 
     def toJSON(self) -> dict:
         json_obj = super().toJSON()
         json_obj["clock_freq"] = self.clock_freq
+        json_obj["variant"] = self.variant
+        json_obj["config"] = self.config
+        json_obj["verilator_args"] = self.verilator_args
+        json_obj["icache_size"] = self.icache_size
+        json_obj["icache_line"] = self.icache_line
+        json_obj["icache_hit_latency"] = self.icache_hit_latency
+        json_obj["cacheable"] = self.cacheable
+        json_obj["dcache_size"] = self.dcache_size
+        json_obj["dcache_line"] = self.dcache_line
+        json_obj["dcache_hit_latency"] = self.dcache_hit_latency
+        json_obj["wcb_size"] = self.wcb_size
+        json_obj["wcb_timeout"] = self.wcb_timeout
+        json_obj["local_mem"] = self.local_mem
+        json_obj["local_elf"] = self.local_elf
+        json_obj["local_mem_latency"] = self.local_mem_latency
+        json_obj["wfi_skip"] = self.wfi_skip
+        json_obj["chan_batch"] = self.chan_batch
+        json_obj["timer_base"] = self.timer_base
+        json_obj["sim_ctrl_base"] = self.sim_ctrl_base
+        json_obj["console"] = self.console
+        json_obj["trace_file"] = self.trace_file
+        json_obj["trace_level"] = self.trace_level
+        json_obj["trace_start"] = self.trace_start
+        json_obj["trace_stop"] = self.trace_stop
+        json_obj["trace_pc"] = self.trace_pc
+        json_obj["trace_addr"] = self.trace_addr
+        json_obj["rvfi_trace"] = self.rvfi_trace
+        json_obj["profile_file"] = self.profile_file
+        json_obj["profile_interval"] = self.profile_interval
+        json_obj["profile_elf"] = self.profile_elf
+        json_obj["profile_format"] = self.profile_format
+        json_obj["mem_stats_file"] = self.mem_stats_file
+        json_obj["mem_stats_elf"] = self.mem_stats_elf
+        json_obj["mem_stats_line"] = self.mem_stats_line
+        json_obj["mem_stats_page"] = self.mem_stats_page
+        json_obj["mem_stats_stack"] = self.mem_stats_stack
+        json_obj["stats_file"] = self.stats_file
+        json_obj["stats_interval"] = self.stats_interval
+        json_obj["pcount_file"] = self.pcount_file
+        json_obj["checkpoint_file"] = self.checkpoint_file
+        json_obj["checkpoint_at"] = self.checkpoint_at
+        json_obj["checkpoint_exit"] = self.checkpoint_exit
+        json_obj["restore_file"] = self.restore_file
+        json_obj["record_file"] = self.record_file
+        json_obj["replay_file"] = self.replay_file
+        json_obj["hang_cycles"] = self.hang_cycles
+        json_obj["hang_span"] = self.hang_span
+        json_obj["hang_idle"] = self.hang_idle
+        json_obj["sim_limit"] = self.sim_limit
+        json_obj["wall_limit"] = self.wall_limit
+        json_obj["core_quantum"] = self.core_quantum
+        json_obj["ff_insns"] = self.ff_insns
+        json_obj["ff_until_pc"] = self.ff_until_pc
+        json_obj["ff_until"] = self.ff_until
+        json_obj["ff_window"] = self.ff_window
+        json_obj["ff_period"] = self.ff_period
         return json_obj
 
     @classmethod
     def fromJSON(cls, simulation: sim_base.Simulation, json_obj: dict) -> tpe.Self:
         instance = super().fromJSON(simulation, json_obj)
         instance.clock_freq = utils_base.get_json_attr_top(json_obj, "clock_freq")
+        instance.variant = utils_base.get_json_attr_top(json_obj, "variant")
+        instance.config = utils_base.get_json_attr_top(json_obj, "config")
+        instance.verilator_args = utils_base.get_json_attr_top(json_obj, "verilator_args")
+        instance.icache_size = utils_base.get_json_attr_top(json_obj, "icache_size")
+        instance.icache_line = utils_base.get_json_attr_top(json_obj, "icache_line")
+        instance.icache_hit_latency = utils_base.get_json_attr_top(
+            json_obj, "icache_hit_latency"
+        )
+        instance.cacheable = [
+            (base, size)
+            for base, size in utils_base.get_json_attr_top(json_obj, "cacheable")
+        ]
+        instance.dcache_size = utils_base.get_json_attr_top(json_obj, "dcache_size")
+        instance.dcache_line = utils_base.get_json_attr_top(json_obj, "dcache_line")
+        instance.dcache_hit_latency = utils_base.get_json_attr_top(
+            json_obj, "dcache_hit_latency"
+        )
+        instance.wcb_size = utils_base.get_json_attr_top(json_obj, "wcb_size")
+        instance.wcb_timeout = utils_base.get_json_attr_top(json_obj, "wcb_timeout")
+        instance.local_mem = [
+            (base, size)
+            for base, size in utils_base.get_json_attr_top(json_obj, "local_mem")
+        ]
+        instance.local_elf = utils_base.get_json_attr_top(json_obj, "local_elf")
+        instance.local_mem_latency = utils_base.get_json_attr_top(
+            json_obj, "local_mem_latency"
+        )
+        instance.wfi_skip = utils_base.get_json_attr_top(json_obj, "wfi_skip")
+        instance.chan_batch = utils_base.get_json_attr_top(json_obj, "chan_batch")
+        instance.timer_base = utils_base.get_json_attr_top(json_obj, "timer_base")
+        instance.sim_ctrl_base = utils_base.get_json_attr_top(json_obj, "sim_ctrl_base")
+        instance.console = utils_base.get_json_attr_top(json_obj, "console")
+        instance.trace_file = utils_base.get_json_attr_top(json_obj, "trace_file")
+        instance.trace_level = utils_base.get_json_attr_top(json_obj, "trace_level")
+        instance.trace_start = utils_base.get_json_attr_top(json_obj, "trace_start")
+        instance.trace_stop = utils_base.get_json_attr_top(json_obj, "trace_stop")
+        instance.trace_pc = utils_base.get_json_attr_top(json_obj, "trace_pc")
+        instance.trace_addr = utils_base.get_json_attr_top(json_obj, "trace_addr")
+        instance.rvfi_trace = utils_base.get_json_attr_top(json_obj, "rvfi_trace")
+        instance.profile_file = utils_base.get_json_attr_top(json_obj, "profile_file")
+        instance.profile_interval = utils_base.get_json_attr_top(json_obj, "profile_interval")
+        instance.profile_elf = utils_base.get_json_attr_top(json_obj, "profile_elf")
+        instance.profile_format = utils_base.get_json_attr_top(json_obj, "profile_format")
+        instance.mem_stats_file = utils_base.get_json_attr_top(json_obj, "mem_stats_file")
+        instance.mem_stats_elf = utils_base.get_json_attr_top(json_obj, "mem_stats_elf")
+        instance.mem_stats_line = utils_base.get_json_attr_top(json_obj, "mem_stats_line")
+        instance.mem_stats_page = utils_base.get_json_attr_top(json_obj, "mem_stats_page")
+        instance.mem_stats_stack = utils_base.get_json_attr_top(json_obj, "mem_stats_stack")
+        instance.stats_file = utils_base.get_json_attr_top(json_obj, "stats_file")
+        instance.stats_interval = utils_base.get_json_attr_top(json_obj, "stats_interval")
+        instance.pcount_file = utils_base.get_json_attr_top(json_obj, "pcount_file")
+        instance.checkpoint_file = utils_base.get_json_attr_top(json_obj, "checkpoint_file")
+        instance.checkpoint_at = utils_base.get_json_attr_top(json_obj, "checkpoint_at")
+        instance.checkpoint_exit = utils_base.get_json_attr_top(json_obj, "checkpoint_exit")
+        instance.restore_file = utils_base.get_json_attr_top(json_obj, "restore_file")
+        instance.record_file = utils_base.get_json_attr_top(json_obj, "record_file")
+        instance.replay_file = utils_base.get_json_attr_top(json_obj, "replay_file")
+        instance.hang_cycles = utils_base.get_json_attr_top(json_obj, "hang_cycles")
+        instance.hang_span = utils_base.get_json_attr_top(json_obj, "hang_span")
+        instance.hang_idle = utils_base.get_json_attr_top(json_obj, "hang_idle")
+        instance.sim_limit = utils_base.get_json_attr_top(json_obj, "sim_limit")
+        instance.wall_limit = utils_base.get_json_attr_top(json_obj, "wall_limit")
+        instance.core_quantum = utils_base.get_json_attr_top(json_obj, "core_quantum")
+        instance.ff_insns = utils_base.get_json_attr_top(json_obj, "ff_insns")
+        instance.ff_until_pc = utils_base.get_json_attr_top(json_obj, "ff_until_pc")
+        instance.ff_until = utils_base.get_json_attr_top(json_obj, "ff_until")
+        instance.ff_window = utils_base.get_json_attr_top(json_obj, "ff_window")
+        instance.ff_period = utils_base.get_json_attr_top(json_obj, "ff_period")
         return instance
 
     def supported_socket_types(self, interface: sys.Interface) -> set[inst_socket.SockType]:
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+# Copyright 2025 Max Planck Institute for Software Systems, and
+# National University of Singapore
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+Runs the benchmark applications through virtual_prototype_bench.py, one
+simbricks-run per benchmark and Ibex configuration, and collects the guest cycle
+counts and the host simulation speed of each run into a table, optionally
+written as CSV or JSON.
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+BENCHMARKS = ["bench_int", "bench_mem", "bench_ptrchase", "bench_branch", "bench_timer"]
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+RESULT_RE = re.compile(r"bench (\S+) (ok|FAIL) result=0x([0-9A-F]+)")
+PHASE_RE = re.compile(r"bench phase (\S+) cycles=0x([0-9A-F]+)(?: bytes=0x([0-9A-F]+))?")
+
+
+def run_benchmark(
+    bench: str,
+    config: str,
+    args: argparse.Namespace,
+    out: str | None = None,
+    extra_env: dict[str, str] | None = None,
+) -> dict:
+    """Runs one benchmark. out overrides args.out and extra_env is added to the
+    environment of virtual_prototype_bench.py, run_sweep.py uses both to run
+    several points at once."""
+    out = out or args.out
+    env = dict(os.environ)
+    env["IBEX_BENCH"] = bench
+    env["IBEX_BENCH_OUT"] = out
+    env["IBEX_VARIANT"] = args.variant
+    env["IBEX_CONFIG"] = config
+    env["IBEX_CHAN_BATCH"] = "0" if args.no_chan_batch else "1"
+    env["IBEX_HARVARD"] = "1" if args.harvard else "0"
+    env.update(extra_env or {})
+    for name in (f"{bench}.pcount.json", f"{bench}.stats.jsonl"):
+        path = os.path.join(out, name)
+        if os.path.exists(path):
+            os.remove(path)
+
+    start = time.monotonic()
+    proc = subprocess.run(
+        args.run + [os.path.join(SCRIPT_DIR, "virtual_prototype_bench.py")],
+        env=env,
+        cwd=SCRIPT_DIR,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+        text=True,
+    )
+    result = {
+        "bench": bench,
+        "config": config or "default",
+        "run_s": round(time.monotonic() - start, 3),
+    }
+    if args.verbose:
+        sys.stdout.write(proc.stdout)
+
+    # guest output printed by the terminal simulator
+    output = proc.stdout
+    match = RESULT_RE.search(output)
+    result["status"] = match.group(2) if match else "no result"
+    if match:
+        result["result"] = int(match.group(3), 16)
+    phases = {}
+    for name, cycles, nbytes in PHASE_RE.findall(output):
+        phase = phases.setdefault(name, {"cycles": 0, "bytes": 0})
+        phase["cycles"] += int(cycles, 16)
+        phase["bytes"] += int(nbytes, 16) if nbytes else 0
+    for name, phase in phases.items():
+        result[f"{name}_cycles"] = phase["cycles"]
+        if phase["bytes"]:
+            result[f"{name}_bytes_per_cycle"] = round(phase["bytes"] / phase["cycles"], 3)
+
+    # counters and statistics the adapter wrote at exit
+    try:
+        with open(os.path.join(out, f"{bench}.pcount.json")) as f:
+            pcount = json.load(f)
+        result.update({k: v for k, v in pcount.items() if k != "halted"})
+    except (OSError, ValueError):
+        result["status"] = "no pcount"
+    try:
+        with open(os.path.join(out, f"{bench}.stats.jsonl")) as f:
+            stats = json.loads(f.readlines()[-1])
+        result["sim_cycles"] = stats["cycles"]
+        result["sim_wall_s"] = round(stats["wall_s"], 3)
+        result["sim_khz"] = round(stats["khz"], 1)
+        # channel operations per simulated cycle
+        result["sim_polls_per_cycle"] = round(stats["polls"] / max(stats["cycles"], 1), 3)
+        result["sim_syncs_per_cycle"] = round(stats["h2m_syncs"] / max(stats["cycles"], 1), 3)
+    except (OSError, ValueError, IndexError):
+        pass
+    return result
+
+
+def print_speedups(results: list[dict], configs: list[str]) -> None:
+    """Guest cycles of every benchmark per configuration, and the speedup over
+    the first configuration."""
+    names = [c or "default" for c in configs]
+    cycles = {(r["bench"], r["config"]): r.get("mcycle") for r in results}
+    print()
+    print(f"{'mcycle':16}" + "".join(f" {name:>18}" for name in names))
+    for bench in dict.fromkeys(r["bench"] for r in results):
+        base = cycles.get((bench, names[0]))
+        line = f"{bench:16}"
+        for name in names:
+            value = cycles.get((bench, name))
+            if value is None:
+                line += f" {'-':>18}"
+            elif base:
+                line += f" {value:>10} ({base / value:4.2f}x)"
+            else:
+                line += f" {value:>18}"
+        print(line)
+
+
+def write_results(results: list[dict], args: argparse.Namespace) -> None:
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(results, f, indent=2)
+    if args.csv:
+        fields = []
+        for result in results:
+            fields += [k for k in result if k not in fields]
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=fields)
+            writer.writeheader()
+            writer.writerows(results)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("benchmarks", nargs="*", default=BENCHMARKS)
+    parser.add_argument("--out", default="/tmp/ibex-bench", help="directory for the adapter output")
+    parser.add_argument("--variant", default="", help="adapter build variant (IbexSim.variant)")
+    parser.add_argument(
+        "--config",
+        action="append",
+        help="Ibex configuration (IbexSim.config), repeat to compare several, "
+        "default is the default build",
+    )
+    parser.add_argument(
+        "--no-chan-batch",
+        action="store_true",
+        help="sync and poll the memory channel every cycle (IbexSim.chan_batch)",
+    )
+    parser.add_argument(
+        "--harvard",
+        action="store_true",
+        help="fetch instructions from a separate memory (IbexHost harvard mode)",
+    )
+    parser.add_argument("--csv", help="write the results as CSV")
+    parser.add_argument("--json", help="write the results as JSON")
+    parser.add_argument("--verbose", action="store_true", help="show the simulation output")
+    parser.add_argument(
+        "--run",
+        default="simbricks-run --verbose",
+        help="command that runs a virtual prototype script",
+    )
+    args = parser.parse_args()
+    args.run = args.run.split()
+    os.makedirs(args.out, exist_ok=True)
+    configs = ["" if c == "default" else c for c in args.config or ["default"]]
+
+    results = []
+    for config in configs:
+        for bench in args.benchmarks:
+            result = run_benchmark(bench, config, args)
+            print(
+                f"{bench:16} {result['config']:10} {result['status']:10} "
+                f"mcycle={result.get('mcycle', '-')} minstret={result.get('minstret', '-')} "
+                f"ipc={result.get('ipc', '-')} khz={result.get('sim_khz', '-')} "
+                f"polls/cycle={result.get('sim_polls_per_cycle', '-')} run_s={result['run_s']}"
+            )
+            results.append(result)
+    if len(configs) > 1:
+        print_speedups(results, configs)
+
+    write_results(results, args)
+    return 0 if all(r["status"] == "ok" for r in results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
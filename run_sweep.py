@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+# Copyright 2025 Max Planck Institute for Software Systems, and
+# National University of Singapore
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+Runs the benchmarks of run_benchmarks.py over a grid of memory channel latency,
+synchronization period, core clock and Ibex configuration, several runs at a
+time on the local machine, and collects the guest cycle counts and the host
+runtime of every point into one table, optionally written as CSV or JSON.
+"""
+
+import argparse
+import concurrent.futures
+import itertools
+import os
+import sys
+
+import run_benchmarks
+
+
+def int_list(value: str) -> list[int]:
+    return [int(v) for v in value.split(",")]
+
+
+def add_deviation(results: list[dict]) -> None:
+    """Deviation of the guest cycles from the run with the shortest sync period
+    and otherwise the same parameters, in percent."""
+    reference = {}
+    for r in sorted(results, key=lambda r: r["sync_ns"]):
+        key = (r["bench"], r["config"], r["latency_ns"], r["clock_mhz"])
+        if r.get("mcycle") and key not in reference:
+            reference[key] = r["mcycle"]
+    for r in results:
+        base = reference.get((r["bench"], r["config"], r["latency_ns"], r["clock_mhz"]))
+        if base and r.get("mcycle"):
+            r["mcycle_dev_pct"] = round(100 * (r["mcycle"] - base) / base, 3)
+
+
+def print_sync_choice(results: list[dict], tolerance: float) -> None:
+    """The longest sync period per point whose cycles stay within tolerance,
+    along with its host runtime."""
+    best = {}
+    for r in results:
+        key = (r["bench"], r["config"], r["latency_ns"], r["clock_mhz"])
+        if r["status"] != "ok" or abs(r.get("mcycle_dev_pct", 0)) > tolerance:
+            continue
+        if key not in best or r["sync_ns"] > best[key]["sync_ns"]:
+            best[key] = r
+    print()
+    print(f"longest sync period within {tolerance}% of the guest cycles")
+    for (bench, config, latency, clock), r in best.items():
+        print(
+            f"{bench:16} {config:10} latency={latency}ns clock={clock}MHz "
+            f"sync={r['sync_ns']}ns mcycle={r['mcycle']} run_s={r['run_s']}"
+        )
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("benchmarks", nargs="*", default=run_benchmarks.BENCHMARKS)
+    parser.add_argument("--out", default="/tmp/ibex-sweep", help="directory for the adapter output")
+    parser.add_argument(
+        "--latency",
+        type=int_list,
+        default=[500],
+        help="comma separated memory channel latencies in ns",
+    )
+    parser.add_argument(
+        "--sync-period",
+        type=int_list,
+        default=[500],
+        help="comma separated synchronization periods in ns",
+    )
+    parser.add_argument(
+        "--clock-mhz",
+        type=int_list,
+        default=[250],
+        help="comma separated core clock frequencies (IbexSim.clock_freq)",
+    )
+    parser.add_argument("--variant", default="", help="adapter build variant (IbexSim.variant)")
+    parser.add_argument(
+        "--config",
+        action="append",
+        help="Ibex configuration (IbexSim.config), repeat to sweep several, "
+        "default is the default build",
+    )
+    parser.add_argument(
+        "--no-chan-batch",
+        action="store_true",
+        help="sync and poll the memory channel every cycle (IbexSim.chan_batch)",
+    )
+    parser.add_argument(
+        "--harvard",
+        action="store_true",
+        help="fetch instructions from a separate memory (IbexHost harvard mode)",
+    )
+    parser.add_argument(
+        "--jobs",
+        type=int,
+        # a synchronized run keeps about four host threads busy
+        default=max(1, (os.cpu_count() or 1) // 4),
+        help="number of runs at the same time",
+    )
+    parser.add_argument(
+        "--tolerance",
+        type=float,
+        default=0.0,
+        help="deviation of the guest cycles in percent that a sync period may cause",
+    )
+    parser.add_argument("--csv", help="write the results as CSV")
+    parser.add_argument("--json", help="write the results as JSON")
+    parser.add_argument("--verbose", action="store_true", help="show the simulation output")
+    parser.add_argument(
+        "--run",
+        default="simbricks-run --verbose",
+        help="command that runs a virtual prototype script",
+    )
+    args = parser.parse_args()
+    args.run = args.run.split()
+    configs = ["" if c == "default" else c for c in args.config or ["default"]]
+
+    # a peer may only advance up to the last sync message plus the latency,
+    # with a longer period both sides wait for each other
+    links = []
+    for latency, sync in itertools.product(args.latency, args.sync_period):
+        if sync > latency:
+            print(f"skipping sync period {sync}ns > latency {latency}ns", file=sys.stderr)
+        else:
+            links.append((latency, sync))
+    points = [
+        (bench, config, latency, sync, clock)
+        for config, (latency, sync), clock, bench in itertools.product(
+            configs, links, args.clock_mhz, args.benchmarks
+        )
+    ]
+
+    def run_point(bench: str, config: str, latency: int, sync: int, clock: int) -> dict:
+        tag = f"-{config or 'default'}-l{latency}-s{sync}-f{clock}"
+        out = os.path.join(args.out, tag[1:])
+        os.makedirs(out, exist_ok=True)
+        env = {
+            "IBEX_LATENCY_NS": str(latency),
+            "IBEX_SYNC_NS": str(sync),
+            "IBEX_CLOCK_MHZ": str(clock),
+            "IBEX_BENCH_TAG": tag,
+        }
+        result = run_benchmarks.run_benchmark(bench, config, args, out=out, extra_env=env)
+        # the sweep parameters go right after the benchmark and configuration
+        params = {"latency_ns": latency, "sync_ns": sync, "clock_mhz": clock}
+        return dict(itertools.islice(result.items(), 2)) | params | result
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as pool:
+        futures = [pool.submit(run_point, *point) for point in points]
+        for future in concurrent.futures.as_completed(futures):
+            result = future.result()
+            print(
+                f"{result['bench']:16} {result['config']:10} latency={result['latency_ns']}ns "
+                f"sync={result['sync_ns']}ns clock={result['clock_mhz']}MHz {result['status']:10} "
+                f"mcycle={result.get('mcycle', '-')} khz={result.get('sim_khz', '-')} "
+                f"run_s={result['run_s']}"
+            )
+        results = [future.result() for future in futures]
+
+    add_deviation(results)
+    if len(args.sync_period) > 1:
+        print_sync_choice(results, args.tolerance)
+
+    run_benchmarks.write_results(results, args)
+    return 0 if all(r["status"] == "ok" for r in results) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+# Copyright 2025 Max Planck Institute for Software Systems, and
+# National University of Singapore
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+Decodes the retirement trace the adapter writes with --rvfi-trace (see the
+"retirement trace" section of adapter/ibex_simbricks.cpp for the format) and
+prints it as text or CSV. Analysis scripts can import read_trace() instead.
+"""
+
+import argparse
+import csv
+import dataclasses
+import os
+import struct
+import sys
+import typing as tp
+
+MAGIC = b"IBEXRVFI"
+VERSION = 1
+BLOCK_HEADER = struct.Struct("<IIQQ")
+
+F_PC = 1 << 0
+F_RD = 1 << 1
+F_MEM = 1 << 2
+F_TRAP = 1 << 3
+F_INTR = 1 << 4
+
+
+@dataclasses.dataclass
+class Record:
+    cycle: int
+    pc: int
+    insn: int
+    rd: int = 0  # 0 if no register was written
+    rd_wdata: int = 0
+    mem_addr: int | None = None
+    mem_rmask: int = 0
+    mem_wmask: int = 0
+    trap: bool = False
+    intr: bool = False
+    dropped: int = 0  # records lost right before this one
+
+
+def _uleb(data: bytes, pos: int) -> tuple[int, int]:
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, pos
+        shift += 7
+
+
+def _sleb(data: bytes, pos: int) -> tuple[int, int]:
+    value, pos = _uleb(data, pos)
+    return (value >> 1) ^ -(value & 1), pos
+
+
+def _decode_block(data: bytes, count: int, cycle: int, dropped: int) -> tp.Iterator[Record]:
+    pos = 0
+    next_pc = mem_addr = 0
+    for _ in range(count):
+        flags = data[pos]
+        pos += 1
+        pc = next_pc
+        if flags & F_PC:
+            delta, pos = _sleb(data, pos)
+            pc = (pc + delta) & 0xFFFFFFFF
+        rec = Record(cycle=0, pc=pc, insn=0, trap=bool(flags & F_TRAP), intr=bool(flags & F_INTR))
+        if flags & F_RD:
+            rec.rd = data[pos]
+            rec.rd_wdata, pos = _uleb(data, pos + 1)
+        if flags & F_MEM:
+            delta, pos = _sleb(data, pos)
+            mem_addr = (mem_addr + delta) & 0xFFFFFFFF
+            rec.mem_addr = mem_addr
+            rec.mem_rmask = data[pos] & 0xF
+            rec.mem_wmask = data[pos] >> 4
+            pos += 1
+        delta, pos = _uleb(data, pos)
+        cycle += delta
+        rec.cycle = cycle
+        insn_len = 4 if data[pos] & 3 == 3 else 2
+        rec.insn = int.from_bytes(data[pos : pos + insn_len], "little")
+        pos += insn_len
+        rec.dropped = dropped
+        dropped = 0
+        next_pc = (pc + insn_len) & 0xFFFFFFFF
+        yield rec
+
+
+def read_trace(path: str) -> tp.Iterator[Record]:
+    with open(path, "rb") as f:
+        header = f.read(16)
+        if len(header) != 16 or header[:8] != MAGIC:
+            raise ValueError(f"{path} is not a retirement trace")
+        version, _hart_id = struct.unpack("<II", header[8:])
+        if version != VERSION:
+            raise ValueError(f"{path} has version {version}, expected {VERSION}")
+        while True:
+            block = f.read(BLOCK_HEADER.size)
+            if not block:
+                return
+            if len(block) != BLOCK_HEADER.size:
+                raise ValueError(f"{path} ends in a block header")
+            length, count, cycle, dropped = BLOCK_HEADER.unpack(block)
+            data = f.read(length)
+            if len(data) != length:
+                raise ValueError(f"{path} ends in a block")
+            yield from _decode_block(data, count, cycle, dropped)
+
+
+def format_record(rec: Record) -> str:
+    insn = f"{rec.insn:08x}" if rec.insn & 3 == 3 else f"    {rec.insn:04x}"
+    line = f"{rec.cycle:12d} {rec.pc:08x} {insn}"
+    if rec.rd:
+        line += f" x{rec.rd}={rec.rd_wdata:08x}"
+    if rec.mem_wmask:
+        line += f" store {rec.mem_addr:08x}/{rec.mem_wmask:x}"
+    elif rec.mem_rmask:
+        line += f" load {rec.mem_addr:08x}/{rec.mem_rmask:x}"
+    if rec.intr:
+        line += " intr"
+    if rec.trap:
+        line += " trap"
+    return line
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("trace", help="file written by --rvfi-trace")
+    parser.add_argument("--csv", action="store_true", help="one CSV row per record")
+    args = parser.parse_args()
+
+    fields = [f.name for f in dataclasses.fields(Record)]
+    writer = csv.DictWriter(sys.stdout, fieldnames=fields) if args.csv else None
+    if writer:
+        writer.writeheader()
+    try:
+        for rec in read_trace(args.trace):
+            if writer:
+                writer.writerow(dataclasses.asdict(rec))
+                continue
+            if rec.dropped:
+                print(f"# {rec.dropped} records dropped")
+            print(format_record(rec))
+    except BrokenPipeError:
+        # output piped into head, keep the interpreter from flushing stdout again
+        os.dup2(os.open(os.devnull, os.O_WRONLY), sys.stdout.fileno())
+    except ValueError as e:
+        print(e, file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -20,6 +20,8 @@
 # TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
 # SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
+import os
+
 from simbricks.orchestration import system
 from simbricks.orchestration import simulation
 from simbricks.orchestration.helpers import simulation as sim_helpers
@@ -45,8 +47,11 @@ System Specification
 """
 syst = system.System()
 
-# create ibex core
-core = ibex.IbexHost(syst)
+# create ibex core, IBEX_HARVARD=1 gives instruction fetches their own memory
+# and IBEX_CORES=N simulates N cores in the same adapter
+harvard = os.environ.get("IBEX_HARVARD", "0") != "0"
+cores = int(os.environ.get("IBEX_CORES", "1"))
+core = ibex.IbexHost(syst, harvard=harvard, cores=cores)
 core.name = "ibex-Core"
 
 # create memory
@@ -61,12 +66,20 @@ terminal.name = "terminal"
 # create interconnect
 ic = system.MemInterconnect(syst)
 ic.name = "interconnect"
-ic.connect_host(core._mem_if)
+for mem_if in core._mem_ifs:
+    ic.connect_host(mem_if)
 c = ic.connect_device(terminal._mem_if)
 ic.add_route(c.host_if(), 0x20000, 0x1000)
 c = ic.connect_device(mem._mem_if)
 ic.add_route(c.host_if(), 0, mem._size)
 
+# instruction memory with the same image per core, connected directly
+for i, imem_if in enumerate(core._imem_ifs):
+    imem = system.MemSimpleDevice(syst)
+    imem.name = f"ibex-imem{i}"
+    imem._load_elf = mem._load_elf
+    system.MemChannel(imem_if, imem._mem_if)
+
 
 """
 Simulator Choice
@@ -82,6 +95,36 @@ sim = sim_helpers.simple_simulation(
 )
 sim.name = 'ibex-sim'
 sim.find_sim(core)._wait = True
+# adapter build variant, Ibex configuration and Verilator plusargs, used by the
+# PGO and benchmark targets of the Makefile
+sim.find_sim(core).variant = os.environ.get("IBEX_VARIANT", "")
+sim.find_sim(core).config = os.environ.get("IBEX_CONFIG", "")
+sim.find_sim(core).verilator_args = os.environ.get("IBEX_VERILATOR_ARGS", "").split()
+# IBEX_CONSOLE=FILE writes the firmware output from the adapter instead of the
+# terminal, which then sees no traffic
+sim.find_sim(core).console = os.environ.get("IBEX_CONSOLE") or None
+# IBEX_RVFI_TRACE=FILE records the retired instructions, needs IBEX_VARIANT=rvfi
+sim.find_sim(core).rvfi_trace = os.environ.get("IBEX_RVFI_TRACE") or None
+# IBEX_PROFILE=FILE samples the guest PC, IBEX_PROFILE_FORMAT=folded writes
+# stacks for flame graphs (with call stacks in the rvfi variant)
+sim.find_sim(core).profile_file = os.environ.get("IBEX_PROFILE") or None
+sim.find_sim(core).profile_elf = mem._load_elf
+sim.find_sim(core).profile_format = os.environ.get("IBEX_PROFILE_FORMAT", "flat")
+# IBEX_MEM_STATS=FILE writes memory access statistics per region and page
+sim.find_sim(core).mem_stats_file = os.environ.get("IBEX_MEM_STATS") or None
+sim.find_sim(core).mem_stats_elf = mem._load_elf
+# IBEX_RECORD=FILE logs the memory channel so the core can be rerun alone with
+# --replay=FILE
+sim.find_sim(core).record_file = os.environ.get("IBEX_RECORD") or None
+# IBEX_HANG_CYCLES=N ends a run that is stuck in a loop without stores or
+# retires nothing for N cycles
+sim.find_sim(core).hang_cycles = int(os.environ.get("IBEX_HANG_CYCLES", "0"))
+# IBEX_DCACHE=BYTES caches loads and IBEX_WCB=BYTES combines stores to the RAM
+# and stack of the application
+if os.environ.get("IBEX_DCACHE") or os.environ.get("IBEX_WCB"):
+    sim.find_sim(core).cacheable = [(0x100000, 0x38000)]
+    sim.find_sim(core).dcache_size = int(os.environ.get("IBEX_DCACHE", "0"), 0)
+    sim.find_sim(core).wcb_size = int(os.environ.get("IBEX_WCB", "0"), 0)
 sim.find_sim(ic).name = 'interconnect'
 
 sim.enable_synchronization(500, utils_base.Time.Nanoseconds)
@@ -0,0 +1,148 @@
+# Copyright 2025 Max Planck Institute for Software Systems, and
+# National University of Singapore
+#
+# Permission is hereby granted, free of charge, to any person obtaining
+# a copy of this software and associated documentation files (the
+# "Software"), to deal in the Software without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Software, and to
+# permit persons to whom the Software is furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be
+# included in all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+"""
+Variant of virtual_prototype.py that runs the benchmark applications under
+app/bench_*. IBEX_BENCH selects a comma separated list of benchmarks (default:
+all), each gets its own instantiation. The adapter writes the guest
+performance counters and its own statistics of each run to IBEX_BENCH_OUT,
+where run_benchmarks.py collects them. IBEX_PROFILE=1 adds a flat guest
+profile per benchmark and IBEX_MEM_STATS=1 the memory access statistics.
+A benchmark that hangs ends after IBEX_HANG_CYCLES cycles in a loop without
+stores (default: 10M, 0 disables it).
+IBEX_LATENCY_NS sets the latency of every memory channel, IBEX_SYNC_NS the
+synchronization period (both default to 500) and IBEX_CLOCK_MHZ the core clock
+(default: 250). IBEX_BENCH_TAG is appended to the simulation names, so runs with
+different parameters can share a machine. IBEX_FF_INSNS runs that many
+instructions in the functional simulator first, IBEX_FF_WINDOW and
+IBEX_FF_PERIOD sample the whole run (see IbexSim.ff_window).
+"""
+
+import os
+
+from simbricks.orchestration import system
+from simbricks.orchestration import simulation
+from simbricks.orchestration.helpers import simulation as sim_helpers
+from simbricks.orchestration.helpers import instantiation as inst_helpers
+from simbricks.orchestration.instantiation import base as inst_base
+from simbricks.utils import base as utils_base
+
+from orchestration import ibex_orchestration as ibex
+
+BENCHMARKS = ["bench_int", "bench_mem", "bench_ptrchase", "bench_branch", "bench_timer"]
+APP_DIR = "/lowrisc-ibex/app"
+
+benchmarks = os.environ.get("IBEX_BENCH", ",".join(BENCHMARKS)).split(",")
+out_dir = os.environ.get("IBEX_BENCH_OUT", "/tmp/ibex-bench")
+variant = os.environ.get("IBEX_VARIANT", "")
+config = os.environ.get("IBEX_CONFIG", "")
+chan_batch = os.environ.get("IBEX_CHAN_BATCH", "1") != "0"
+harvard = os.environ.get("IBEX_HARVARD", "0") != "0"
+profile = os.environ.get("IBEX_PROFILE", "0") != "0"
+mem_stats = os.environ.get("IBEX_MEM_STATS", "0") != "0"
+hang_cycles = int(os.environ.get("IBEX_HANG_CYCLES", "10000000"))
+latency_ns = int(os.environ.get("IBEX_LATENCY_NS", "500"))
+sync_ns = int(os.environ.get("IBEX_SYNC_NS", "500"))
+clock_mhz = int(os.environ.get("IBEX_CLOCK_MHZ", "250"))
+tag = os.environ.get("IBEX_BENCH_TAG", "")
+ff_insns = os.environ.get("IBEX_FF_INSNS")
+ff_window = os.environ.get("IBEX_FF_WINDOW")
+ff_period = os.environ.get("IBEX_FF_PERIOD")
+
+instantiations = []
+
+
+def bench_instantiation(bench: str) -> inst_base.Instantiation:
+    syst = system.System()
+
+    core = ibex.IbexHost(syst, harvard=harvard)
+    core.name = "ibex-Core"
+
+    mem = system.MemSimpleDevice(syst)
+    mem.name = "ibex-memory"
+    mem._load_elf = f"{APP_DIR}/{bench}/{bench}.elf"
+
+    terminal = system.MemTerminal(syst)
+    terminal.name = "terminal"
+
+    ic = system.MemInterconnect(syst)
+    ic.name = "interconnect"
+    channels = [ic.connect_host(core._mem_if)]
+    c = ic.connect_device(terminal._mem_if)
+    ic.add_route(c.host_if(), 0x20000, 0x1000)
+    channels.append(c)
+    c = ic.connect_device(mem._mem_if)
+    ic.add_route(c.host_if(), 0, mem._size)
+    channels.append(c)
+
+    if harvard:
+        imem = system.MemSimpleDevice(syst)
+        imem.name = "ibex-imem"
+        imem._load_elf = mem._load_elf
+        channels.append(system.MemChannel(core._imem_if, imem._mem_if))
+
+    for chan in channels:
+        chan.set_latency(latency_ns, utils_base.Time.Nanoseconds)
+
+    sim = sim_helpers.simple_simulation(
+        syst,
+        compmap={
+            ibex.IbexHost: ibex.IbexSim,
+            system.MemSimpleDevice: simulation.BasicMem,
+            system.MemTerminal: simulation.MemTerminal,
+            system.MemInterconnect: simulation.BasicInterconnect,
+        },
+    )
+    sim.name = f"ibex-{bench}{tag}"
+    ibex_sim = sim.find_sim(core)
+    ibex_sim._wait = True
+    ibex_sim.clock_freq = clock_mhz
+    ibex_sim.variant = variant
+    ibex_sim.config = config
+    ibex_sim.chan_batch = chan_batch
+    ibex_sim.pcount_file = f"{out_dir}/{bench}.pcount.json"
+    ibex_sim.stats_file = f"{out_dir}/{bench}.stats.jsonl"
+    ibex_sim.hang_cycles = hang_cycles
+    if ff_insns:
+        ibex_sim.ff_insns = int(ff_insns)
+    if ff_window:
+        ibex_sim.ff_window = int(ff_window)
+    if ff_period:
+        ibex_sim.ff_period = int(ff_period)
+    if profile:
+        ibex_sim.profile_file = f"{out_dir}/{bench}.profile.txt"
+        ibex_sim.profile_elf = mem._load_elf
+    if mem_stats:
+        ibex_sim.mem_stats_file = f"{out_dir}/{bench}.mem.json"
+        ibex_sim.mem_stats_elf = mem._load_elf
+    sim.find_sim(ic).name = "interconnect"
+
+    sim.enable_synchronization(sync_ns, utils_base.Time.Nanoseconds)
+
+    instance = inst_helpers.simple_instantiation(sim)
+    instance.fragments[0]._fragment_executor_tag = "ibex_executor"
+    return instance
+
+
+os.makedirs(out_dir, exist_ok=True)
+for bench in benchmarks:
+    instantiations.append(bench_instantiation(bench))